@@ -4,6 +4,7 @@
 #include <freertos/FreeRTOS.h>
 #include "button.h"
 #include "radio.h"
+#include "dlog.h"
 
 static const char LOG_TAG[] = __FILE__;
 
@@ -26,14 +27,14 @@ void button_task_fun(void *_)
             if (button_click_down > 0 && millis() - button_click_down > BUTTON_TASK_INTERVAL_MILLIS)
             {
                 button_click_down = 0;
-                ESP_LOGI(LOG_TAG, "button pressed down");
+                DLOGI(LOG_TAG, "button pressed down");
                 radio_tx_start();
             }
         }
         else if (button_click_down == 0)
         {
             button_click_down = millis();
-            ESP_LOGI(LOG_TAG, "button released");
+            DLOGI(LOG_TAG, "button released");
             radio_tx_stop();
         }
         esp_task_wdt_reset();
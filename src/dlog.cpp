@@ -0,0 +1,206 @@
+#include <Arduino.h>
+#include <Esp.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "dlog.h"
+
+static const char LOG_TAG[] = __FILE__;
+
+struct dlog_record
+{
+    // seq is position + 1 once the producer has finished writing the record at that ring position.
+    std::atomic<uint32_t> seq;
+    esp_log_level_t level;
+    int num_args;
+    const char *tag, *fmt;
+    int64_t micros;
+    union dlog_arg args[DLOG_MAX_ARGS];
+};
+
+// Each core has its own ring to keep producers on different cores from contending. Tasks on the same core, and tasks
+// that migrate in between, reserve positions with a compare-and-swap on the head, so a ring has no lock at all.
+struct dlog_ring
+{
+    std::atomic<uint32_t> head, tail;
+    struct dlog_record records[DLOG_RING_SIZE];
+};
+
+static struct dlog_ring rings[portNUM_PROCESSORS];
+static std::atomic<uint32_t> dropped(0);
+// Only one consumer may drain the rings at a time, the restart paths flush them from outside of the logging task.
+static std::atomic_flag draining = ATOMIC_FLAG_INIT;
+// The cost of dlog_write in CPU cycles, accumulated since the latest statistics report.
+static std::atomic<uint32_t> write_count(0), write_cycles(0), write_max_cycles(0);
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt, int num_args, const union dlog_arg *args)
+{
+    uint32_t start = ESP.getCycleCount();
+    struct dlog_ring *ring = &rings[xPortGetCoreID()];
+    uint32_t pos = ring->head.load(std::memory_order_relaxed);
+    do
+    {
+        if (pos - ring->tail.load(std::memory_order_acquire) >= (uint32_t)DLOG_RING_SIZE)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!ring->head.compare_exchange_weak(pos, pos + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    struct dlog_record *record = &ring->records[pos % DLOG_RING_SIZE];
+    record->level = level;
+    record->tag = tag;
+    record->fmt = fmt;
+    record->micros = esp_timer_get_time();
+    record->num_args = num_args;
+    memcpy(record->args, args, num_args * sizeof(union dlog_arg));
+    record->seq.store(pos + 1, std::memory_order_release);
+
+    uint32_t cycles = ESP.getCycleCount() - start;
+    write_count.fetch_add(1, std::memory_order_relaxed);
+    write_cycles.fetch_add(cycles, std::memory_order_relaxed);
+    uint32_t max_cycles = write_max_cycles.load(std::memory_order_relaxed);
+    while (cycles > max_cycles && !write_max_cycles.compare_exchange_weak(max_cycles, cycles, std::memory_order_relaxed))
+    {
+    }
+}
+
+// dlog_format renders a record, it formats one conversion at a time as the argument types are only known from the format string.
+static void dlog_format(const struct dlog_record *record, char *out, int out_len)
+{
+    int len = 0, next_arg = 0;
+    const char *c = record->fmt;
+    while (*c != '\0' && len < out_len - 1)
+    {
+        if (*c != '%')
+        {
+            out[len++] = *c++;
+            continue;
+        }
+        if (c[1] == '%')
+        {
+            out[len++] = '%';
+            c += 2;
+            continue;
+        }
+        // Copy the conversion specification up to and including its conversion character.
+        char spec[16];
+        int spec_len = 0, longs = 0;
+        spec[spec_len++] = *c++;
+        while (*c != '\0' && spec_len < (int)sizeof(spec) - 1)
+        {
+            char ch = *c++;
+            spec[spec_len++] = ch;
+            if (ch == 'l')
+            {
+                ++longs;
+            }
+            else if (strchr("diouxXcfFeEgGsp", ch) != NULL)
+            {
+                break;
+            }
+        }
+        spec[spec_len] = '\0';
+        union dlog_arg arg = next_arg < record->num_args ? record->args[next_arg++] : dlog_pack(0);
+        int n;
+        switch (spec[spec_len - 1])
+        {
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            n = snprintf(out + len, out_len - len, spec, arg.d);
+            break;
+        case 's':
+            n = snprintf(out + len, out_len - len, spec, arg.s != NULL ? arg.s : "(null)");
+            break;
+        case 'p':
+            n = snprintf(out + len, out_len - len, spec, (void *)arg.s);
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            n = longs >= 2  ? snprintf(out + len, out_len - len, spec, (unsigned long long)arg.i)
+                : longs == 1 ? snprintf(out + len, out_len - len, spec, (unsigned long)arg.i)
+                             : snprintf(out + len, out_len - len, spec, (unsigned int)arg.i);
+            break;
+        default:
+            n = longs >= 2  ? snprintf(out + len, out_len - len, spec, (long long)arg.i)
+                : longs == 1 ? snprintf(out + len, out_len - len, spec, (long)arg.i)
+                             : snprintf(out + len, out_len - len, spec, (int)arg.i);
+            break;
+        }
+        if (n < 0)
+        {
+            break;
+        }
+        len = min(len + n, out_len - 1);
+    }
+    out[len] = '\0';
+}
+
+// dlog_next_ring returns the ring holding the oldest committed record, or NULL if all rings are empty.
+static struct dlog_ring *dlog_next_ring()
+{
+    struct dlog_ring *oldest = NULL;
+    int64_t oldest_micros = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; i++)
+    {
+        uint32_t pos = rings[i].tail.load(std::memory_order_relaxed);
+        struct dlog_record *record = &rings[i].records[pos % DLOG_RING_SIZE];
+        if (record->seq.load(std::memory_order_acquire) == pos + 1 && (oldest == NULL || record->micros < oldest_micros))
+        {
+            oldest = &rings[i];
+            oldest_micros = record->micros;
+        }
+    }
+    return oldest;
+}
+
+void dlog_flush()
+{
+    // A restart path must not lose the records the logging task is still draining, so it waits for its turn.
+    int waited_millis = 0;
+    while (draining.test_and_set(std::memory_order_acquire))
+    {
+        if (waited_millis++ >= DLOG_FLUSH_TIMEOUT_MILLIS)
+        {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    char line[DLOG_LINE_MAX_LEN];
+    struct dlog_ring *ring;
+    while ((ring = dlog_next_ring()) != NULL)
+    {
+        uint32_t pos = ring->tail.load(std::memory_order_relaxed);
+        const struct dlog_record *record = &ring->records[pos % DLOG_RING_SIZE];
+        dlog_format(record, line, sizeof(line));
+        esp_log_write(record->level, record->tag, "%c (%lu) %s: %s\n", "NEWIDV"[record->level],
+                      (unsigned long)(record->micros / 1000), record->tag, line);
+        ring->tail.store(pos + 1, std::memory_order_release);
+    }
+    draining.clear(std::memory_order_release);
+}
+
+void dlog_task_fun(void *_)
+{
+    unsigned long rounds = 0;
+    while (true)
+    {
+        esp_task_wdt_reset();
+        dlog_flush();
+        if (++rounds % (DLOG_STATS_INTERVAL_MILLIS / DLOG_TASK_INTERVAL_MILLIS) == 0)
+        {
+            uint32_t count = write_count.exchange(0), cycles = write_cycles.exchange(0);
+            ESP_LOGI(LOG_TAG, "deferred log: %u records, %u dropped, avg. %u cycles per call, max. %u cycles",
+                     count, dropped.load(), count > 0 ? cycles / count : 0, write_max_cycles.exchange(0));
+        }
+        vTaskDelay(pdMS_TO_TICKS(DLOG_TASK_INTERVAL_MILLIS));
+    }
+}
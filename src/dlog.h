@@ -0,0 +1,101 @@
+#pragma once
+
+#include <esp_log.h>
+#include <stdint.h>
+
+// The deferred log keeps the hot paths clear of text formatting and UART output. A caller stores the format string
+// pointer along with the raw arguments in a lock-free ring, and a low priority task formats and emits them later.
+// Format strings and %s arguments must therefore be in static storage, and "*" widths are not supported.
+
+// DLOG_RING_SIZE is the capacity of the ring of each CPU core, it must be a power of two.
+const int DLOG_RING_SIZE = 64;
+const int DLOG_MAX_ARGS = 6;
+const int DLOG_LINE_MAX_LEN = 160;
+const int DLOG_TASK_INTERVAL_MILLIS = 50;
+// dlog_flush gives up waiting for another drain to finish after this long.
+const int DLOG_FLUSH_TIMEOUT_MILLIS = 1000;
+const int DLOG_STATS_INTERVAL_MILLIS = 60 * 1000;
+
+union dlog_arg
+{
+    int64_t i;
+    double d;
+    const char *s;
+};
+
+static inline union dlog_arg dlog_pack(int v)
+{
+    union dlog_arg arg;
+    arg.i = v;
+    return arg;
+}
+
+static inline union dlog_arg dlog_pack(unsigned int v)
+{
+    union dlog_arg arg;
+    arg.i = v;
+    return arg;
+}
+
+static inline union dlog_arg dlog_pack(long v)
+{
+    union dlog_arg arg;
+    arg.i = v;
+    return arg;
+}
+
+static inline union dlog_arg dlog_pack(unsigned long v)
+{
+    union dlog_arg arg;
+    arg.i = v;
+    return arg;
+}
+
+static inline union dlog_arg dlog_pack(long long v)
+{
+    union dlog_arg arg;
+    arg.i = v;
+    return arg;
+}
+
+static inline union dlog_arg dlog_pack(unsigned long long v)
+{
+    union dlog_arg arg;
+    arg.i = (int64_t)v;
+    return arg;
+}
+
+static inline union dlog_arg dlog_pack(double v)
+{
+    union dlog_arg arg;
+    arg.d = v;
+    return arg;
+}
+
+static inline union dlog_arg dlog_pack(const char *v)
+{
+    union dlog_arg arg;
+    arg.s = v;
+    return arg;
+}
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt, int num_args, const union dlog_arg *args);
+
+template <typename... Args>
+static inline void dlog(esp_log_level_t level, const char *tag, const char *fmt, Args... args)
+{
+    static_assert(sizeof...(args) <= DLOG_MAX_ARGS, "too many arguments for a deferred log record");
+    // The trailing element keeps the array valid when there are no arguments.
+    const union dlog_arg packed[] = {dlog_pack(args)..., dlog_pack(0)};
+    dlog_write(level, tag, fmt, sizeof...(args), packed);
+}
+
+// The deferred counterparts of ESP_LOGx, they honour the same compile-time LOG_LOCAL_LEVEL.
+#define DLOGE(tag, fmt, ...) do { if (LOG_LOCAL_LEVEL >= ESP_LOG_ERROR) dlog(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__); } while (0)
+#define DLOGW(tag, fmt, ...) do { if (LOG_LOCAL_LEVEL >= ESP_LOG_WARN) dlog(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__); } while (0)
+#define DLOGI(tag, fmt, ...) do { if (LOG_LOCAL_LEVEL >= ESP_LOG_INFO) dlog(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__); } while (0)
+#define DLOGD(tag, fmt, ...) do { if (LOG_LOCAL_LEVEL >= ESP_LOG_DEBUG) dlog(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__); } while (0)
+#define DLOGV(tag, fmt, ...) do { if (LOG_LOCAL_LEVEL >= ESP_LOG_VERBOSE) dlog(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__); } while (0)
+
+void dlog_flush();
+void dlog_task_fun(void *_);
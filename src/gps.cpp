@@ -0,0 +1,127 @@
+#include <Arduino.h>
+#include <esp_log.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include "gps.h"
+
+static const char LOG_TAG[] = __FILE__;
+
+// gps_spinlock guards the timebase and the position, which the GPS task updates while other tasks stamp their events.
+static portMUX_TYPE gps_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+// The parser is only used by the GPS task, or by the caller of gps_replay_line in its stead.
+static struct gps_nmea_parser parser;
+static struct gps_timebase timebase;
+static struct gps_timestamp position;
+// pps_queue carries the local time of PPS edges from the interrupt handler to the GPS task, which qualifies them.
+static QueueHandle_t pps_queue = xQueueCreate(GPS_PPS_QUEUE_LEN, sizeof(int64_t));
+
+#ifdef GPS_PPS_GPIO
+static void IRAM_ATTR gps_pps_isr()
+{
+    BaseType_t woken = pdFALSE;
+    int64_t now = esp_timer_get_time();
+    xQueueSendFromISR(pps_queue, &now, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+#endif
+
+void gps_init()
+{
+    ESP_LOGI(LOG_TAG, "initialising GPS");
+    gps_timebase_init(&timebase);
+    Serial1.begin(GPS_UART_BAUD, SERIAL_8N1, GPS_RX_PIN, GPS_TX_PIN);
+#ifdef GPS_PPS_GPIO
+    // The timepulse output drives the pin actively, the input-only pins of the ESP32 have no pull of their own.
+    pinMode(GPS_PPS_GPIO, INPUT);
+    attachInterrupt(GPS_PPS_GPIO, gps_pps_isr, RISING);
+#else
+    ESP_LOGW(LOG_TAG, "PPS is not wired, the timebase follows the NMEA sentences");
+#endif
+    ESP_LOGI(LOG_TAG, "GPS initialised successfully");
+}
+
+void gps_pps_edge(int64_t local_micros)
+{
+    portENTER_CRITICAL(&gps_spinlock);
+    gps_timebase_pps(&timebase, local_micros);
+    portEXIT_CRITICAL(&gps_spinlock);
+}
+
+// gps_handle_event applies a sentence completed by the parser to the timebase or the position.
+static void gps_handle_event(enum gps_nmea_event event, int64_t local_micros)
+{
+    portENTER_CRITICAL(&gps_spinlock);
+    if (event == GPS_NMEA_RMC)
+    {
+        gps_timebase_anchor(&timebase, parser.rmc_utc_micros, local_micros);
+    }
+    else if (event == GPS_NMEA_GGA)
+    {
+        position.has_fix = parser.has_fix;
+        position.satellites = parser.satellites;
+        position.latitude = parser.latitude;
+        position.longitude = parser.longitude;
+        position.altitude_metre = parser.altitude_metre;
+    }
+    portEXIT_CRITICAL(&gps_spinlock);
+}
+
+void gps_feed(char c, int64_t local_micros)
+{
+    gps_handle_event(gps_nmea_feed(&parser, c), local_micros);
+}
+
+// gps_replay_line stands in for the UART and the PPS interrupt when replaying a recording, see gps_nmea_replay_line.
+void gps_replay_line(const char *line)
+{
+    int64_t local_micros;
+    enum gps_nmea_event event = gps_nmea_replay_line(&parser, line, &local_micros);
+    if (event == GPS_NMEA_PPS)
+    {
+        gps_pps_edge(local_micros);
+        return;
+    }
+    gps_handle_event(event, local_micros);
+}
+
+void gps_stamp(int64_t local_micros, struct gps_timestamp *stamp)
+{
+    portENTER_CRITICAL(&gps_spinlock);
+    *stamp = position;
+    stamp->valid = timebase.anchored;
+    stamp->pps_locked = timebase.anchored_pps && local_micros - timebase.pps_valid_micros < GPS_PPS_TIMEOUT_MICROS;
+    stamp->utc_micros = gps_timebase_utc(&timebase, local_micros);
+    portEXIT_CRITICAL(&gps_spinlock);
+}
+
+void gps_task_fun(void *_)
+{
+    unsigned long rounds = 0;
+    while (true)
+    {
+        esp_task_wdt_reset();
+        // The edges come first, a sentence read in this round may belong to the epoch that one of them began.
+        int64_t edge;
+        while (xQueueReceive(pps_queue, &edge, 0) == pdTRUE)
+        {
+            gps_pps_edge(edge);
+        }
+        while (Serial1.available() > 0)
+        {
+            gps_feed((char)Serial1.read(), esp_timer_get_time());
+        }
+        if (++rounds % (60000 / GPS_TASK_INTERVAL_MILLIS) == 0)
+        {
+            struct gps_timestamp now;
+            gps_stamp(esp_timer_get_time(), &now);
+            ESP_LOGI(LOG_TAG, "utc %lld us, valid %d, pps locked %d, rate %.7f, fix %d, satellites %d, %.6f %.6f, bad sentences %lu, rejected PPS edges %lu",
+                     now.utc_micros, now.valid, now.pps_locked, timebase.rate, now.has_fix, now.satellites, now.latitude, now.longitude,
+                     parser.sentence_errors, timebase.pps_rejected);
+        }
+        vTaskDelay(pdMS_TO_TICKS(GPS_TASK_INTERVAL_MILLIS));
+    }
+}
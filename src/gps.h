@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include "gps_core.h"
+
+const int GPS_TASK_INTERVAL_MILLIS = 20;
+const int GPS_UART_BAUD = 9600;
+const int GPS_RX_PIN = 34;
+const int GPS_TX_PIN = 12;
+// GPS_PPS_QUEUE_LEN is the number of edges held for the GPS task, a few suffice at one edge per second.
+const int GPS_PPS_QUEUE_LEN = 4;
+
+// A PPS edge older than this no longer disciplines the timebase.
+const int GPS_PPS_TIMEOUT_MICROS = 1500000;
+
+// gps_timestamp is a point in time on the GPS-disciplined timebase along with the latest known position.
+struct gps_timestamp
+{
+    // utc_micros is the number of microseconds since the unix epoch.
+    int64_t utc_micros;
+    // valid is true once the timebase has been anchored to GPS time.
+    bool valid;
+    // pps_locked is true when the timebase follows the PPS edge rather than the coarser NMEA sentence arrival.
+    bool pps_locked;
+    bool has_fix;
+    double latitude, longitude;
+    float altitude_metre;
+    int satellites;
+};
+
+void gps_init();
+void gps_feed(char c, int64_t local_micros);
+void gps_pps_edge(int64_t local_micros);
+void gps_replay_line(const char *line);
+void gps_stamp(int64_t local_micros, struct gps_timestamp *stamp);
+void gps_task_fun(void *_);
@@ -0,0 +1,264 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gps_core.h"
+
+// days_from_civil converts a proleptic Gregorian date to the number of days since the unix epoch.
+static int64_t days_from_civil(int year, int month, int day)
+{
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return (int64_t)era * 146097 + day_of_era - 719468;
+}
+
+static int two_digits(const char *s)
+{
+    return (s[0] - '0') * 10 + (s[1] - '0');
+}
+
+// parse_coordinate converts an NMEA (d)ddmm.mmmm coordinate to signed decimal degrees.
+static double parse_coordinate(const char *value, const char *hemisphere)
+{
+    double raw = strtod(value, NULL);
+    int degrees = (int)(raw / 100);
+    double result = degrees + (raw - degrees * 100) / 60.0;
+    return (hemisphere[0] == 'S' || hemisphere[0] == 'W') ? -result : result;
+}
+
+static enum gps_nmea_event gps_nmea_parse_rmc(struct gps_nmea_parser *parser, char **fields, int num_fields)
+{
+    if (num_fields < 10 || fields[2][0] != 'A' || strlen(fields[1]) < 6 || strlen(fields[9]) != 6)
+    {
+        return GPS_NMEA_NONE;
+    }
+    const char *time = fields[1], *date = fields[9];
+    int64_t seconds = days_from_civil(2000 + two_digits(date + 4), two_digits(date + 2), two_digits(date)) * 86400 +
+                      two_digits(time) * 3600 + two_digits(time + 2) * 60 + two_digits(time + 4);
+    int64_t fraction_micros = time[6] == '.' ? (int64_t)(strtod(time + 6, NULL) * 1000000) : 0;
+    parser->rmc_utc_micros = seconds * 1000000 + fraction_micros;
+    return GPS_NMEA_RMC;
+}
+
+static enum gps_nmea_event gps_nmea_parse_gga(struct gps_nmea_parser *parser, char **fields, int num_fields)
+{
+    if (num_fields < 10)
+    {
+        return GPS_NMEA_NONE;
+    }
+    parser->has_fix = atoi(fields[6]) > 0;
+    parser->satellites = atoi(fields[7]);
+    if (parser->has_fix)
+    {
+        parser->latitude = parse_coordinate(fields[2], fields[3]);
+        parser->longitude = parse_coordinate(fields[4], fields[5]);
+        parser->altitude_metre = strtof(fields[9], NULL);
+    }
+    return GPS_NMEA_GGA;
+}
+
+// gps_nmea_parse_sentence verifies the checksum of a complete sentence and splits its fields in place.
+static enum gps_nmea_event gps_nmea_parse_sentence(struct gps_nmea_parser *parser)
+{
+    char *sentence = parser->sentence;
+    char *star = strchr(sentence, '*');
+    if (sentence[0] != '$' || star == NULL || star[1] == '\0' || star[2] == '\0')
+    {
+        ++parser->sentence_errors;
+        return GPS_NMEA_NONE;
+    }
+    uint8_t checksum = 0;
+    for (char *c = sentence + 1; c < star; c++)
+    {
+        checksum ^= *c;
+    }
+    if (checksum != strtol(star + 1, NULL, 16))
+    {
+        ++parser->sentence_errors;
+        return GPS_NMEA_NONE;
+    }
+    *star = '\0';
+
+    char *fields[GPS_NMEA_MAX_FIELDS];
+    int num_fields = 0;
+    fields[num_fields++] = sentence;
+    for (char *c = sentence; *c != '\0' && num_fields < GPS_NMEA_MAX_FIELDS; c++)
+    {
+        if (*c == ',')
+        {
+            *c = '\0';
+            fields[num_fields++] = c + 1;
+        }
+    }
+    // Accept any talker, such as GP for GPS only and GN for multi-constellation receivers.
+    if (strlen(fields[0]) != 6)
+    {
+        return GPS_NMEA_NONE;
+    }
+    if (strcmp(fields[0] + 3, "RMC") == 0)
+    {
+        return gps_nmea_parse_rmc(parser, fields, num_fields);
+    }
+    if (strcmp(fields[0] + 3, "GGA") == 0)
+    {
+        return gps_nmea_parse_gga(parser, fields, num_fields);
+    }
+    return GPS_NMEA_NONE;
+}
+
+enum gps_nmea_event gps_nmea_feed(struct gps_nmea_parser *parser, char c)
+{
+    if (c == '$')
+    {
+        parser->sentence_len = 0;
+    }
+    if (c == '\r' || c == '\n')
+    {
+        if (parser->sentence_len == 0)
+        {
+            return GPS_NMEA_NONE;
+        }
+        parser->sentence[parser->sentence_len] = '\0';
+        parser->sentence_len = 0;
+        return gps_nmea_parse_sentence(parser);
+    }
+    if (parser->sentence_len >= GPS_NMEA_MAX_LEN)
+    {
+        // Discard an overlong sentence until the next one begins.
+        ++parser->sentence_errors;
+        parser->sentence_len = 0;
+        return GPS_NMEA_NONE;
+    }
+    parser->sentence[parser->sentence_len++] = c;
+    return GPS_NMEA_NONE;
+}
+
+// gps_nmea_replay_line consumes a line of recorded GPS activity in the form of "<local micros> PPS" or
+// "<local micros> <NMEA sentence>", and tells the local time of the recorded event.
+enum gps_nmea_event gps_nmea_replay_line(struct gps_nmea_parser *parser, const char *line, int64_t *local_micros)
+{
+    char *payload;
+    *local_micros = strtoll(line, &payload, 10);
+    while (*payload == ' ')
+    {
+        payload++;
+    }
+    if (strncmp(payload, "PPS", 3) == 0)
+    {
+        return GPS_NMEA_PPS;
+    }
+    // The line ending, if any, is left for the final feed to complete the sentence with.
+    for (const char *c = payload; *c != '\0' && *c != '\r' && *c != '\n'; c++)
+    {
+        gps_nmea_feed(parser, *c);
+    }
+    return gps_nmea_feed(parser, '\n');
+}
+
+void gps_timebase_init(struct gps_timebase *timebase)
+{
+    memset(timebase, 0, sizeof(*timebase));
+    timebase->rate = 1.0;
+}
+
+// pps_tolerance_micros is how far a PPS edge may stray after elapsed_micros of local time.
+static int64_t pps_tolerance_micros(int64_t elapsed_micros)
+{
+    return llabs(elapsed_micros) / 1000000 * GPS_PPS_MAX_DEVIATION_PPM + GPS_PPS_MAX_DEVIATION_PPM;
+}
+
+// gps_timebase_pps qualifies a PPS edge. An edge one second after the previous one is valid, an edge sooner than that
+// is rejected as noise, and an edge after a longer pause starts over as the reference for the next one.
+// It returns true if the edge is valid.
+bool gps_timebase_pps(struct gps_timebase *timebase, int64_t local_micros)
+{
+    bool first = timebase->pps_edge_micros == 0;
+    int64_t since = local_micros - timebase->pps_edge_micros;
+    if (!first && since < 1000000 - pps_tolerance_micros(1000000))
+    {
+        ++timebase->pps_rejected;
+        return false;
+    }
+    timebase->pps_edge_micros = local_micros;
+    if (first || since > 1000000 + pps_tolerance_micros(1000000))
+    {
+        return false;
+    }
+    timebase->pps_valid_micros = local_micros;
+    return true;
+}
+
+// gps_timebase_pps_edge picks the edge that began the navigation epoch of a sentence. It is the latest valid edge, or
+// after a pause in the edges the latest one if it falls on a second of the timebase. It returns 0 if there is none.
+static int64_t gps_timebase_pps_edge(const struct gps_timebase *timebase, int64_t sentence_local_micros)
+{
+    int64_t since_valid = sentence_local_micros - timebase->pps_valid_micros;
+    if (timebase->pps_valid_micros != 0 && since_valid >= 0 && since_valid < 1000000)
+    {
+        return timebase->pps_valid_micros;
+    }
+    int64_t since_edge = sentence_local_micros - timebase->pps_edge_micros;
+    if (timebase->anchored_pps && timebase->pps_edge_micros != 0 && since_edge >= 0 && since_edge < 1000000)
+    {
+        int64_t utc = gps_timebase_utc(timebase, timebase->pps_edge_micros);
+        int64_t off_second = (utc % 1000000 + 1000000) % 1000000;
+        off_second = off_second < 500000 ? off_second : 1000000 - off_second;
+        if (off_second <= pps_tolerance_micros(timebase->pps_edge_micros - timebase->anchor_local_micros))
+        {
+            return timebase->pps_edge_micros;
+        }
+    }
+    return 0;
+}
+
+// gps_timebase_anchor ties the UTC time carried by an RMC sentence to the local time. The sentence is tied to the PPS
+// edge that began its navigation epoch where there is one, or else to its own arrival.
+void gps_timebase_anchor(struct gps_timebase *timebase, int64_t utc_micros, int64_t sentence_local_micros)
+{
+    int64_t pps_local_micros = gps_timebase_pps_edge(timebase, sentence_local_micros);
+    if (pps_local_micros == 0)
+    {
+        timebase->anchor_local_micros = sentence_local_micros;
+        timebase->anchor_utc_micros = utc_micros;
+        timebase->anchored_pps = false;
+        timebase->stale_sentences = 0;
+        timebase->anchored = true;
+        return;
+    }
+    int64_t pps_utc = utc_micros - utc_micros % 1000000;
+    if (timebase->anchored_pps)
+    {
+        // A sentence read late, after the next edge, would otherwise move the timebase by a whole second.
+        int64_t error = llabs(gps_timebase_utc(timebase, pps_local_micros) - pps_utc);
+        bool agrees = error <= pps_tolerance_micros(pps_local_micros - timebase->anchor_local_micros);
+        // Consistent disagreement means that the timebase itself is off, so it is moved after all.
+        if (!agrees && ++timebase->stale_sentences < GPS_PPS_MAX_STALE_SENTENCES)
+        {
+            return;
+        }
+        if (agrees && pps_utc > timebase->anchor_utc_micros)
+        {
+            double measured = (double)(pps_local_micros - timebase->anchor_local_micros) / (double)(pps_utc - timebase->anchor_utc_micros);
+            if (fabs(measured - 1.0) * 1e6 < GPS_PPS_MAX_DEVIATION_PPM)
+            {
+                timebase->rate += (measured - timebase->rate) / GPS_RATE_SMOOTHING;
+            }
+        }
+    }
+    timebase->anchor_local_micros = pps_local_micros;
+    timebase->anchor_utc_micros = pps_utc;
+    timebase->anchored_pps = true;
+    timebase->stale_sentences = 0;
+    timebase->anchored = true;
+}
+
+int64_t gps_timebase_utc(const struct gps_timebase *timebase, int64_t local_micros)
+{
+    if (!timebase->anchored)
+    {
+        return 0;
+    }
+    return timebase->anchor_utc_micros + (int64_t)((local_micros - timebase->anchor_local_micros) / timebase->rate);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// The hardware independent part of the GPS service: the NMEA parser, the timebase discipline and the replay of
+// recorded GPS activity. It uses neither the UART nor FreeRTOS, hence it also builds on a host.
+
+#include <stdint.h>
+
+// GPS_NMEA_MAX_LEN is the longest sentence permitted by NMEA 0183, including the leading $ and the trailing CR LF.
+const int GPS_NMEA_MAX_LEN = 82;
+const int GPS_NMEA_MAX_FIELDS = 20;
+// PPS edges, and the local oscillator rate estimate, may deviate this far from one second per second.
+const int GPS_PPS_MAX_DEVIATION_PPM = 500;
+// The timebase is moved anyway after this many consecutive sentences disagree with its prediction of the PPS edge.
+const int GPS_PPS_MAX_STALE_SENTENCES = 3;
+// GPS_RATE_SMOOTHING is the reciprocal of the weight given to each new oscillator rate measurement.
+const int GPS_RATE_SMOOTHING = 8;
+
+enum gps_nmea_event
+{
+    GPS_NMEA_NONE,
+    GPS_NMEA_RMC,
+    GPS_NMEA_GGA,
+    // GPS_NMEA_PPS is only produced by the replay of a recorded PPS edge.
+    GPS_NMEA_PPS,
+};
+
+// gps_nmea_parser accumulates a sentence in a fixed buffer and parses it in place once the line ends.
+struct gps_nmea_parser
+{
+    char sentence[GPS_NMEA_MAX_LEN + 1];
+    int sentence_len;
+    unsigned long sentence_errors;
+    // The content of the latest valid RMC sentence, utc_micros is the number of microseconds since the unix epoch.
+    int64_t rmc_utc_micros;
+    // The content of the latest GGA sentence.
+    bool has_fix;
+    int satellites;
+    double latitude, longitude;
+    float altitude_metre;
+};
+
+// gps_timebase maps local time to UTC: utc = anchor_utc + (local - anchor_local) / rate.
+struct gps_timebase
+{
+    int64_t anchor_local_micros, anchor_utc_micros;
+    double rate;
+    bool anchored, anchored_pps;
+    // pps_edge_micros is the latest edge that was not rejected, pps_valid_micros is the latest edge that came one
+    // second after its predecessor. Only the latter may anchor the timebase.
+    int64_t pps_edge_micros, pps_valid_micros;
+    unsigned long pps_rejected;
+    // stale_sentences counts the consecutive sentences that did not belong to the epoch of the latest valid edge.
+    int stale_sentences;
+};
+
+enum gps_nmea_event gps_nmea_feed(struct gps_nmea_parser *parser, char c);
+enum gps_nmea_event gps_nmea_replay_line(struct gps_nmea_parser *parser, const char *line, int64_t *local_micros);
+void gps_timebase_init(struct gps_timebase *timebase);
+bool gps_timebase_pps(struct gps_timebase *timebase, int64_t local_micros);
+void gps_timebase_anchor(struct gps_timebase *timebase, int64_t utc_micros, int64_t sentence_local_micros);
+int64_t gps_timebase_utc(const struct gps_timebase *timebase, int64_t local_micros);
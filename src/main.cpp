@@ -16,6 +16,9 @@
 #include "oled.h"
 #include "button.h"
 #include "radio.h"
+#include "gps.h"
+#include "dlog.h"
+#include "warmboot.h"
 
 static const char LOG_TAG[] = __FILE__;
 
@@ -31,10 +34,15 @@ void setup(void)
            getXtalFrequencyMhz(), getCpuFrequencyMhz(), getApbFrequency() / 1000000);
 
   // Initialise hardware and peripherals in the correct order.
+  // The state kept in RTC memory decides whether the initialisation may take shortcuts after a software restart.
+  warmboot_init();
   power_init();
+  gps_init();
   oled_init();
   button_init();
   radio_init();
+  warmboot_restore();
+  warmboot_save();
   // Start background tasks.
   supervisor_init();
   ESP_LOGI(LOG_TAG, "main task initialised successfully");
@@ -51,6 +59,8 @@ void loop()
   else
   {
     ESP_LOGW(LOG_TAG, "performing a routine restart");
+    warmboot_save();
+    dlog_flush();
     esp_restart();
   }
   // Use arduino's delay instead of vTaskDelay to avoid a deadlock in arduino's loop function.
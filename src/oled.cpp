@@ -34,6 +34,10 @@ void oled_display_refresh()
     {
         snprintf(status_line, OLED_MAX_LINE_LEN, "TRANSMITTING @ %.2f", radio_centre_freq);
     }
+    else if (radio_watching)
+    {
+        snprintf(status_line, OLED_MAX_LINE_LEN, "Watching @ %.2fMHz", radio_centre_freq);
+    }
     else
     {
         snprintf(status_line, OLED_MAX_LINE_LEN, "Centre @ %.2fMHz", radio_centre_freq);
@@ -3,6 +3,8 @@
 #include <SPI.h>
 #include "oled.h"
 #include "power.h"
+#include "dlog.h"
+#include "warmboot.h"
 
 static const char LOG_TAG[] = __FILE__;
 
@@ -11,6 +13,32 @@ static struct power_status status;
 static SemaphoreHandle_t i2c_mutex = xSemaphoreCreateMutex();
 static bool pmu_irq_flag = false;
 
+// The PMU registers programmed by power_init, their checksum tells whether a warm restart may skip the programming.
+#ifdef AXP192
+static const uint8_t PMU_CONFIG_REGS[] = {0x12, 0x23, 0x26, 0x28, 0x30, 0x31, 0x32, 0x33, 0x35, 0x36, 0x40, 0x41, 0x42, 0x43, 0x82, 0x83};
+#endif
+#ifdef AXP2101
+static const uint8_t PMU_CONFIG_REGS[] = {0x15, 0x16, 0x18, 0x24, 0x27, 0x30, 0x40, 0x41, 0x42, 0x50, 0x61, 0x62, 0x63, 0x64, 0x6A, 0x80, 0x82, 0x90, 0x91, 0x93, 0x94};
+#endif
+
+// power_read_config_checksum reads back the PMU configuration registers. The caller must hold the I2C lock.
+static uint32_t power_read_config_checksum()
+{
+    uint8_t values[sizeof(PMU_CONFIG_REGS)] = {0};
+    for (size_t i = 0; i < sizeof(PMU_CONFIG_REGS); i++)
+    {
+        Wire.beginTransmission(POWER_PMU_I2C_ADDR);
+        Wire.write(PMU_CONFIG_REGS[i]);
+        if (Wire.endTransmission(false) != 0 || Wire.requestFrom(POWER_PMU_I2C_ADDR, 1) != 1)
+        {
+            ESP_LOGE(LOG_TAG, "failed to read PMU register 0x%02x", PMU_CONFIG_REGS[i]);
+            return 0;
+        }
+        values[i] = Wire.read();
+    }
+    return warmboot_checksum(values, sizeof(values));
+}
+
 void power_init()
 {
     ESP_LOGI(LOG_TAG, "initialising power and peripherals");
@@ -38,8 +66,17 @@ void power_init()
     }
 #endif
 
+    uint32_t pmu_checksum = power_read_config_checksum();
+    if (warmboot_is_warm && pmu_checksum != 0 && pmu_checksum == warmboot.pmu_config_checksum)
+    {
+        // The PMU kept its configuration across the software restart, only the ESP32 side needs setting up again.
+        ESP_LOGI(LOG_TAG, "PMU configuration is intact, skipping its setup");
+        pinMode(POWER_PMU_IRQ, INPUT);
+        attachInterrupt(POWER_PMU_IRQ, power_set_pmu_irq_flag, FALLING);
+        pmu->clearIrqStatus();
+    }
     // Set USB power limits.
-    if (pmu->getChipModel() == XPOWERS_AXP192)
+    else if (pmu->getChipModel() == XPOWERS_AXP192)
     {
         ESP_LOGI(LOG_TAG, "setting up AXP192");
 #ifdef AXP192
@@ -77,6 +114,7 @@ void power_init()
         // https://www.u-blox.com/sites/default/files/products/documents/NEO-6_DataSheet_(GPS.G6-HW-09005).pdf
         // "NEO-6Q/M NEO-6P/V/T Min: 2.7, Typ: 3.0, Max: 3.6"
         pmu->setLDO3Voltage(3000);
+        pmu->enableLDO3();
 
         // Start charging the battery if it is installed.
         // The maximum supported charging current is 1.4A.
@@ -181,6 +219,7 @@ void power_init()
         pmu->clearIrqStatus();
 #endif
     }
+    warmboot.pmu_config_checksum = power_read_config_checksum();
     power_i2c_unlock();
     ESP_LOGI(LOG_TAG, "power and peripherals initialised successfully");
 }
@@ -213,19 +252,19 @@ void power_read_handle_lastest_irq()
         pmu->getIrqStatus();
         if (pmu->isBatInsertIrq())
         {
-            ESP_LOGI(LOG_TAG, "battery inserted");
+            DLOGI(LOG_TAG, "battery inserted");
         }
         if (pmu->isBatRemoveIrq())
         {
-            ESP_LOGI(LOG_TAG, "battery removed");
+            DLOGI(LOG_TAG, "battery removed");
         }
         if (pmu->isBatChargeDoneIrq())
         {
-            ESP_LOGI(LOG_TAG, "battery charging completed");
+            DLOGI(LOG_TAG, "battery charging completed");
         }
         if (pmu->isPekeyShortPressIrq())
         {
-            ESP_LOGI(LOG_TAG, "Pekey short click");
+            DLOGI(LOG_TAG, "Pekey short click");
         }
         if (pmu->isPekeyLongPressIrq())
         {
@@ -12,6 +12,8 @@
 
 // POWER_PMU_IRQ is the IRQ of the AXP192 and AXP2101 PMU chip on TTGO-TBeam.
 #define POWER_PMU_IRQ 35
+// POWER_PMU_I2C_ADDR is shared by both AXP192 and AXP2101.
+#define POWER_PMU_I2C_ADDR 0x34
 
 const int POWER_MUTEX_TIMEOUT_MILLIS = 10;
 const int POWER_TASK_INTERVAL_MILLIS = 1000;
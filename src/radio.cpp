@@ -1,49 +1,463 @@
 #include <esp_log.h>
 #include <esp_task_wdt.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <RadioLib.h>
 #include "radio.h"
+#include "dlog.h"
 
 static const char LOG_TAG[] = __FILE__;
 
 static SX1276 radio = new Module(RADIO_NSS_PIN, RADIO_DIO0_PIN, RADIO_RESET_PIN, RADIO_DIO1_PIN);
 static SemaphoreHandle_t radio_mutex = xSemaphoreCreateMutex();
+static QueueHandle_t tx_queue = xQueueCreate(RADIO_TX_QUEUE_LEN, sizeof(struct radio_tx_job));
 
 bool radio_tx = false;
-float radio_centre_freq = RADIO_FIRST_CHAN + (RADIO_STEP_SIZE * (RADIO_MAX_STEPS / 2));
-int sample_index = 0;
+bool radio_tx_packet = false;
+struct radio_tx_report radio_tx_report;
+volatile bool radio_tx_request = false;
+bool radio_scan_partial = false;
+int radio_band = RADIO_DEFAULT_BAND;
+float radio_centre_freq = RADIO_BANDS[RADIO_DEFAULT_BAND].first_chan + (RADIO_BANDS[RADIO_DEFAULT_BAND].step_size * (RADIO_MAX_STEPS / 2));
 int radio_rssi[RADIO_MAX_STEPS][RADIO_RECENT_SAMPLES] = {0};
+int64_t radio_tx_latency_micros = 0, radio_tx_latency_max_micros = 0;
+bool radio_watching = false;
+int64_t radio_watch_latency_micros = 0, radio_watch_latency_max_micros = 0;
+struct radio_detection radio_detection;
+int64_t radio_first_sweep_micros = 0;
+uint32_t radio_complete_sweeps = 0;
+struct gps_timestamp radio_sweep_stamp;
 
-void radio_init()
+// scan_next_step is the step at which the next scan begins, it is non-zero when a sweep was interrupted by transmission.
+static int scan_next_step = 0;
+static int64_t scan_start_micros = 0;
+static int scan_complete_sweeps = 0;
+// scan_steps counts every retune, the scheduler measures the age of bins in steps.
+static uint32_t scan_steps = 0;
+
+// bins holds the sweep scheduler state of each bin.
+static struct
 {
-    ESP_LOGI(LOG_TAG, "initialising radio");
-    int state = radio.beginFSK(868.0, 0.5, 0.6, 125.0, 20, 16, true);
+    bool visited;
+    float mean, variance, weight;
+    float interval_micros;
+    uint32_t last_step;
+    int64_t last_micros;
+    // sample_index is the slot in radio_rssi that holds the latest sample of the bin.
+    int sample_index;
+} bins[RADIO_MAX_STEPS];
+// sched_floor is the mean level of the quietest bin.
+static float sched_floor = 0;
+
+// The watch mode parks the receiver with the RSSI interrupt routed to DIO0, which is only possible in continuous mode.
+static const uint8_t REG_RSSI_THRESH = 0x10;
+static const uint8_t REG_PREAMBLE_DETECT = 0x1F;
+static const uint8_t REG_PACKET_CONFIG_2 = 0x31;
+static const uint8_t REG_IRQ_FLAGS_1 = 0x3E;
+static const uint8_t REG_DIO_MAPPING_1 = 0x40;
+static const uint8_t PACKET_CONFIG_2_DATA_MODE_PACKET = 0x40;
+static const uint8_t PREAMBLE_DETECTOR_ON = 0x80;
+static const uint8_t IRQ_FLAGS_1_RSSI = 0x08;
+static const uint8_t DIO_MAPPING_1_DIO0_MASK = 0xC0;
+static const uint8_t DIO_MAPPING_1_DIO0_RSSI_OR_PREAMBLE = 0x40;
+static const uint8_t OP_MODE_MASK = 0x07;
+static const uint8_t OP_MODE_RX = 0x05;
+
+// The packet transmission engine refills the FIFO from DIO1 and learns about the end of a frame from DIO0.
+static const uint8_t REG_FIFO = 0x00;
+static const uint8_t REG_PREAMBLE_MSB = 0x25;
+static const uint8_t REG_PREAMBLE_LSB = 0x26;
+static const uint8_t REG_SYNC_CONFIG = 0x27;
+static const uint8_t REG_PACKET_CONFIG_1 = 0x30;
+static const uint8_t REG_PAYLOAD_LENGTH = 0x32;
+static const uint8_t REG_FIFO_THRESH = 0x35;
+static const uint8_t REG_IRQ_FLAGS_2 = 0x3F;
+static const uint8_t SYNC_CONFIG_SYNC_ON = 0x10;
+static const uint8_t PACKET_CONFIG_2_PAYLOAD_LENGTH_MSB_MASK = 0x07;
+static const uint8_t FIFO_THRESH_TX_START_FIFO_NOT_EMPTY = 0x80;
+static const uint8_t IRQ_FLAGS_1_FIFO_OVERRUN = 0x10;
+static const uint8_t IRQ_FLAGS_2_FIFO_EMPTY = 0x40;
+static const uint8_t IRQ_FLAGS_2_FIFO_LEVEL = 0x20;
+static const uint8_t IRQ_FLAGS_2_PACKET_SENT = 0x08;
+static const uint8_t DIO_MAPPING_1_DIO0_DIO1_MASK = 0xF0;
+static const uint8_t OP_MODE_STANDBY = 0x01;
+static const uint8_t OP_MODE_TX = 0x03;
+static const int FIFO_SIZE = 64;
+// FifoLevel drops once the FIFO holds no more than this many bytes, leaving about 2 ms of data at 100 kbps to refill.
+static const int FIFO_REFILL_THRESHOLD = 24;
+// A gap shorter than this is timed by spinning on the timer instead of sleeping.
+static const int TX_GAP_SPIN_MICROS = 2000;
+
+static TaskHandle_t radio_task, tx_task;
+static volatile bool tx_active = false;
+// tx_sent_micros is the time of the PacketSent interrupt of the frame being transmitted. The task may see the flag
+// before the interrupt handler is done writing the time, hence tx_spinlock.
+static volatile int64_t tx_sent_micros = 0;
+static portMUX_TYPE tx_spinlock = portMUX_INITIALIZER_UNLOCKED;
+// tx_ptt_pending asks the packet transmission engine to give the radio up to push-to-talk.
+static volatile bool tx_ptt_pending = false;
+static volatile bool watch_armed = false;
+static volatile int64_t watch_trigger_micros = 0;
+// watch_bin is the bin the receiver is parked on, the interrupt handler copies it to watch_trigger_bin.
+static volatile int watch_bin = 0, watch_trigger_bin = 0;
+// The registers overwritten by parking, restored once the watch ends.
+static bool watch_parked = false;
+static uint8_t watch_saved_packet_config_2, watch_saved_preamble_detect, watch_saved_dio_mapping_1;
+static int watch_idle_sweeps = 0;
+// pass_peak_rssi is the strongest sample of the ongoing sweep.
+static int pass_peak_rssi = -200;
+
+// SX1276 FSK/OOK registers that make up the configuration of a band. The FIFO, IRQ flags, live RSSI/FEI readings
+// and the reserved registers 0x17-0x18 are left out, and the operating mode is restored separately after all other registers.
+static const uint8_t BAND_IMAGE_REGS[] = {
+    0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10,
+    0x12, 0x13, 0x14, 0x15, 0x16, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3D, 0x40, 0x41, 0x44, 0x4B, 0x4D, 0x5D, 0x61, 0x62,
+    0x63, 0x64};
+static const int BAND_IMAGE_NUM_REGS = sizeof(BAND_IMAGE_REGS);
+static const uint8_t REG_OP_MODE = 0x01;
+static const uint8_t REG_IMAGE_CAL = 0x3B;
+static const uint8_t IMAGE_CAL_START = 0x40;
+static const uint8_t IMAGE_CAL_RUNNING = 0x20;
+static const int IMAGE_CAL_TIMEOUT_MILLIS = 20;
+
+// band_cache holds the register image of each band captured after its first full configuration.
+static struct
+{
+    bool valid;
+    uint8_t op_mode;
+    uint8_t regs[BAND_IMAGE_NUM_REGS];
+} band_cache[RADIO_NUM_BANDS];
+
+// radio_calibrate_image runs the SX1276 image and RSSI calibration for the current frequency.
+// The trim values stay inside the chip and cannot be read back, so they are redone on every band switch.
+static void radio_calibrate_image()
+{
+    Module *mod = radio.getMod();
+    int state = radio.standby();
     if (state != RADIOLIB_ERR_NONE)
     {
-        ESP_LOGE(LOG_TAG, "failed to initialise radio: %d", state);
+        DLOGE(LOG_TAG, "failed to set radio to standby: %d", state);
+    }
+    mod->SPIwriteRegister(REG_IMAGE_CAL, mod->SPIreadRegister(REG_IMAGE_CAL) | IMAGE_CAL_START);
+    unsigned long start = millis();
+    while (mod->SPIreadRegister(REG_IMAGE_CAL) & IMAGE_CAL_RUNNING)
+    {
+        if (millis() - start > IMAGE_CAL_TIMEOUT_MILLIS)
+        {
+            DLOGE(LOG_TAG, "image calibration timed out");
+            break;
+        }
+        // Let other tasks run while the calibration takes its few milliseconds.
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+// radio_apply_modulation sets the receiver modulation of a band through RadioLib, which keeps its own copy of the
+// modulation, bit rate and deviation to validate later settings against. The caller must hold the radio lock.
+static void radio_apply_modulation(const struct radio_band_profile *profile)
+{
+    int state = radio.setOOK(profile->ook);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set modulation: %d", state);
+    }
+    state = radio.setBitRate(profile->bit_rate_kbps);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set bit rate: %d", state);
+    }
+    state = radio.setFrequencyDeviation(profile->freq_dev_khz);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set frequency deviation: %d", state);
+    }
+}
+
+// radio_configure_band applies a band profile with the individual setters and captures the resulting register image.
+// The caller must hold the radio lock.
+static void radio_configure_band(int band)
+{
+    const struct radio_band_profile *profile = &RADIO_BANDS[band];
+    int state = radio.setFrequency(profile->first_chan);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set frequency: %d", state);
+    }
+    state = radio.setRxBandwidth(profile->rx_bandwidth_khz);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set receiver bandwidth: %d", state);
+    }
+    state = radio.setAFCBandwidth(profile->afc_bandwidth_khz);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set AFC bandwidth: %d", state);
+    }
+    state = radio.setAFC(profile->afc);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to enable AFC: %d", state);
+    }
+    state = radio.setOutputPower(profile->max_power_dbm);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set output power: %d", state);
+    }
+    radio_apply_modulation(profile);
+    radio_calibrate_image();
+
+    Module *mod = radio.getMod();
+    band_cache[band].op_mode = mod->SPIreadRegister(REG_OP_MODE);
+    for (int i = 0; i < BAND_IMAGE_NUM_REGS; i++)
+    {
+        band_cache[band].regs[i] = mod->SPIreadRegister(BAND_IMAGE_REGS[i]);
+    }
+    band_cache[band].valid = true;
+}
+
+// radio_restore_band writes back the cached register image of a band in bulk. The caller must hold the radio lock.
+// The image calibration may be skipped when the chip has stayed in the band since it was last calibrated.
+static void radio_restore_band(int band, bool calibrate)
+{
+    Module *mod = radio.getMod();
+    int state = radio.standby();
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set radio to standby: %d", state);
+    }
+    // The low frequency mode bit selects the RF port, it has to be in place before the carrier frequency is written.
+    mod->SPIwriteRegister(REG_OP_MODE, band_cache[band].op_mode);
+    for (int i = 0; i < BAND_IMAGE_NUM_REGS; i++)
+    {
+        mod->SPIwriteRegister(BAND_IMAGE_REGS[i], band_cache[band].regs[i]);
+    }
+    if (calibrate)
+    {
+        radio_calibrate_image();
+    }
+}
+
+static void IRAM_ATTR radio_dio0_isr()
+{
+    BaseType_t woken = pdFALSE;
+    if (watch_armed)
+    {
+        watch_armed = false;
+        watch_trigger_micros = esp_timer_get_time();
+        watch_trigger_bin = watch_bin;
+        vTaskNotifyGiveFromISR(radio_task, &woken);
+    }
+    else if (tx_active)
+    {
+        // DIO0 signals PacketSent during a transmission.
+        portENTER_CRITICAL_ISR(&tx_spinlock);
+        tx_sent_micros = esp_timer_get_time();
+        portEXIT_CRITICAL_ISR(&tx_spinlock);
+        vTaskNotifyGiveFromISR(tx_task, &woken);
+    }
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void IRAM_ATTR radio_dio1_isr()
+{
+    BaseType_t woken = pdFALSE;
+    if (tx_active)
+    {
+        vTaskNotifyGiveFromISR(tx_task, &woken);
+    }
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// radio_busy tells whether a transmission owns the radio. The caller must hold the radio lock.
+static bool radio_busy()
+{
+    return radio_tx || radio_tx_packet;
+}
+
+// radio_watch_park tunes the receiver to a frequency and routes the RSSI threshold to DIO0, leaving the receiver
+// in standby for radio_watch_listen. The caller must hold the radio lock.
+static void radio_watch_park(float freq, float threshold_dbm)
+{
+    Module *mod = radio.getMod();
+    int state = radio.standby();
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set radio to standby: %d", state);
     }
-    state = radio.setRxBandwidth(2.6);
+    state = radio.setFrequency(freq);
     if (state != RADIOLIB_ERR_NONE)
     {
-        ESP_LOGE(LOG_TAG, "failed to set receiver bandwidth: %d", state);
+        DLOGE(LOG_TAG, "failed to set frequency %.4f MHz: %d", freq, state);
+    }
+    if (!watch_parked)
+    {
+        watch_saved_packet_config_2 = mod->SPIreadRegister(REG_PACKET_CONFIG_2);
+        watch_saved_preamble_detect = mod->SPIreadRegister(REG_PREAMBLE_DETECT);
+        watch_saved_dio_mapping_1 = mod->SPIreadRegister(REG_DIO_MAPPING_1);
+        watch_parked = true;
+    }
+    // RssiOrPreambleDetect only reaches DIO0 in continuous mode, and with the preamble detector off it is purely RSSI.
+    mod->SPIwriteRegister(REG_PACKET_CONFIG_2, watch_saved_packet_config_2 & ~PACKET_CONFIG_2_DATA_MODE_PACKET);
+    mod->SPIwriteRegister(REG_PREAMBLE_DETECT, watch_saved_preamble_detect & ~PREAMBLE_DETECTOR_ON);
+    mod->SPIwriteRegister(REG_DIO_MAPPING_1, (watch_saved_dio_mapping_1 & ~DIO_MAPPING_1_DIO0_MASK) | DIO_MAPPING_1_DIO0_RSSI_OR_PREAMBLE);
+    // The threshold register holds the negated threshold in 0.5 dB steps.
+    mod->SPIwriteRegister(REG_RSSI_THRESH, (uint8_t)constrain(-threshold_dbm * 2, 0, 255));
+    mod->SPIwriteRegister(REG_IRQ_FLAGS_1, IRQ_FLAGS_1_RSSI);
+}
+
+// radio_watch_listen starts receiving on the parked frequency. The interrupt must be armed beforehand, because the RSSI
+// flag stays latched until the receiver leaves RX and DIO0 rises only once. The caller must hold the radio lock.
+static void radio_watch_listen()
+{
+    Module *mod = radio.getMod();
+    mod->SPIwriteRegister(REG_OP_MODE, (mod->SPIreadRegister(REG_OP_MODE) & ~OP_MODE_MASK) | OP_MODE_RX);
+}
+
+// radio_watch_unpark restores the registers changed by parking. The caller must hold the radio lock.
+static void radio_watch_unpark()
+{
+    if (!watch_parked)
+    {
+        return;
     }
-    state = radio.setAFCBandwidth(2.6);
+    watch_armed = false;
+    Module *mod = radio.getMod();
+    int state = radio.standby();
     if (state != RADIOLIB_ERR_NONE)
     {
-        ESP_LOGE(LOG_TAG, "failed to set AFC bandwidth: %d", state);
+        DLOGE(LOG_TAG, "failed to set radio to standby: %d", state);
     }
-    state = radio.setAFC(true);
+    mod->SPIwriteRegister(REG_PACKET_CONFIG_2, watch_saved_packet_config_2);
+    mod->SPIwriteRegister(REG_PREAMBLE_DETECT, watch_saved_preamble_detect);
+    mod->SPIwriteRegister(REG_DIO_MAPPING_1, watch_saved_dio_mapping_1);
+    watch_parked = false;
+}
+
+void radio_init()
+{
+    ESP_LOGI(LOG_TAG, "initialising radio");
+    int state = radio.beginFSK(RADIO_BANDS[RADIO_DEFAULT_BAND].first_chan, 0.5, 0.6, 125.0, 20, 16, true);
     if (state != RADIOLIB_ERR_NONE)
     {
-        ESP_LOGE(LOG_TAG, "failed to enable AFC: %d", state);
+        ESP_LOGE(LOG_TAG, "failed to initialise radio: %d", state);
     }
     state = radio.setDataShapingOOK(1);
     if (state != RADIOLIB_ERR_NONE)
     {
         ESP_LOGE(LOG_TAG, "failed to set OOK data shaping: %d", state);
     }
+    radio_lock();
+    radio_configure_band(RADIO_DEFAULT_BAND);
+    radio_unlock();
+    pinMode(RADIO_DIO0_PIN, INPUT);
+    attachInterrupt(RADIO_DIO0_PIN, radio_dio0_isr, RISING);
+    pinMode(RADIO_DIO1_PIN, INPUT);
+    attachInterrupt(RADIO_DIO1_PIN, radio_dio1_isr, FALLING);
     ESP_LOGI(LOG_TAG, "radio initialised successfully");
 }
 
+void radio_set_band(int band)
+{
+    if (band < 0 || band >= RADIO_NUM_BANDS)
+    {
+        ESP_LOGE(LOG_TAG, "band %d does not exist", band);
+        return;
+    }
+    radio_lock();
+    if (radio_busy())
+    {
+        radio_unlock();
+        DLOGW(LOG_TAG, "cannot switch band during transmission");
+        return;
+    }
+    radio_watch_unpark();
+    int64_t start = esp_timer_get_time();
+    bool cached = band_cache[band].valid;
+    if (cached)
+    {
+        radio_restore_band(band, true);
+        // The image carries the modulation of the band, RadioLib has to be told about it as well.
+        radio_apply_modulation(&RADIO_BANDS[band]);
+    }
+    else
+    {
+        radio_configure_band(band);
+    }
+    radio_band = band;
+    radio_centre_freq = RADIO_BANDS[band].first_chan + (RADIO_BANDS[band].step_size * (RADIO_MAX_STEPS / 2));
+    // Readings from the previous band are meaningless in the new one.
+    scan_next_step = 0;
+    radio_scan_partial = false;
+    memset(radio_rssi, 0, sizeof(radio_rssi));
+    memset(bins, 0, sizeof(bins));
+    radio_unlock();
+    DLOGI(LOG_TAG, "switched to %s MHz band in %lld us (%s)", RADIO_BANDS[band].name,
+          esp_timer_get_time() - start, cached ? "cached" : "configured");
+}
+
+bool radio_save_state(struct radio_saved_state *state)
+{
+    // The supervisor saves the state on its way to restarting a stuck device, where asserting on the lock would turn
+    // a clean restart into a panic.
+    if (xSemaphoreTake(radio_mutex, RADIO_MUTEX_TIMEOUT_MILLIS) == pdFALSE)
+    {
+        return false;
+    }
+    state->band = radio_band;
+    for (int i = 0; i < RADIO_MAX_STEPS; i++)
+    {
+        state->sample_index[i] = bins[i].sample_index;
+    }
+    memcpy(state->rssi, radio_rssi, sizeof(radio_rssi));
+    state->complete_sweeps = radio_complete_sweeps;
+    state->tx_latency_max_micros = radio_tx_latency_max_micros;
+    radio_unlock();
+    return true;
+}
+
+void radio_restore_state(const struct radio_saved_state *state)
+{
+    if (state->band != radio_band)
+    {
+        radio_set_band(state->band);
+    }
+    radio_lock();
+    for (int i = 0; i < RADIO_MAX_STEPS; i++)
+    {
+        bins[i].sample_index = state->sample_index[i] % RADIO_RECENT_SAMPLES;
+    }
+    memcpy(radio_rssi, state->rssi, sizeof(radio_rssi));
+    radio_complete_sweeps = state->complete_sweeps;
+    radio_tx_latency_max_micros = state->tx_latency_max_micros;
+    radio_unlock();
+}
+
+bool radio_get_bin_stats(int bin, struct radio_bin_stats *stats)
+{
+    if (bin < 0 || bin >= RADIO_MAX_STEPS)
+    {
+        ESP_LOGE(LOG_TAG, "bin %d does not exist", bin);
+        return false;
+    }
+    radio_lock();
+    stats->mean_rssi = bins[bin].mean;
+    stats->stddev_rssi = sqrtf(bins[bin].variance);
+    stats->weight = bins[bin].weight;
+    stats->sample_rate_hz = bins[bin].interval_micros > 0 ? 1000000 / bins[bin].interval_micros : 0;
+    stats->age_micros = bins[bin].visited ? esp_timer_get_time() - bins[bin].last_micros : 0;
+    radio_unlock();
+    return true;
+}
+
 void radio_lock()
 {
     if (xSemaphoreTake(radio_mutex, RADIO_MUTEX_TIMEOUT_MILLIS) == pdFALSE)
@@ -58,27 +472,72 @@ void radio_unlock()
     xSemaphoreGive(radio_mutex);
 }
 
+// radio_tx_default_freq is the carrier frequency of push-to-talk, the centre of the scan unless that lies outside of
+// the transmission edges of the band.
+static float radio_tx_default_freq()
+{
+    const struct radio_band_profile *profile = &RADIO_BANDS[radio_band];
+    if (radio_centre_freq >= profile->tx_min_freq && radio_centre_freq <= profile->tx_max_freq)
+    {
+        return radio_centre_freq;
+    }
+    return (profile->tx_min_freq + profile->tx_max_freq) / 2;
+}
+
 void radio_tx_start()
 {
+    int64_t requested_at = esp_timer_get_time();
+    // Ask the scan to yield the radio, it checks the request in between steps.
+    radio_tx_request = true;
     radio_lock();
+    radio_tx_request = false;
     if (radio_tx)
     {
         radio_unlock();
         return;
     }
+    if (radio_tx_packet)
+    {
+        // The packet transmission engine cuts its burst short and releases the radio.
+        tx_ptt_pending = true;
+        xTaskNotifyGive(tx_task);
+        radio_unlock();
+        int64_t deadline = requested_at + RADIO_TX_PTT_YIELD_MILLIS * 1000LL;
+        while (radio_tx_packet && esp_timer_get_time() < deadline)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+        radio_lock();
+        if (radio_tx_packet)
+        {
+            tx_ptt_pending = false;
+            radio_unlock();
+            DLOGE(LOG_TAG, "packet transmission did not yield the radio, ignoring push-to-talk");
+            return;
+        }
+    }
+    tx_ptt_pending = false;
     radio_tx = true;
-    int state = radio.setFrequency(radio_centre_freq);
+    radio_watch_unpark();
+    float freq = radio_tx_default_freq();
+    int state = radio.setFrequency(freq);
     if (state != RADIOLIB_ERR_NONE)
     {
-        ESP_LOGE(LOG_TAG, "failed to set frequency: %d", state);
+        DLOGE(LOG_TAG, "failed to set frequency: %d", state);
     }
     state = radio.transmitDirect();
     if (state != RADIOLIB_ERR_NONE)
     {
-        ESP_LOGE(LOG_TAG, "failed to transmit: %d", state);
+        DLOGE(LOG_TAG, "failed to transmit: %d", state);
+    }
+    radio_tx_latency_micros = esp_timer_get_time() - requested_at;
+    if (radio_tx_latency_micros > radio_tx_latency_max_micros)
+    {
+        radio_tx_latency_max_micros = radio_tx_latency_micros;
     }
-    ESP_LOGI(LOG_TAG, "radio transmission begins");
     radio_unlock();
+    DLOGI(LOG_TAG, "radio transmission begins at %.4f MHz, press-to-carrier latency %lld us (max. %lld us)",
+             freq, radio_tx_latency_micros, radio_tx_latency_max_micros);
 }
 
 void radio_tx_stop()
@@ -92,48 +551,614 @@ void radio_tx_stop()
     int state = radio.standby();
     if (state != RADIOLIB_ERR_NONE)
     {
-        ESP_LOGE(LOG_TAG, "failed to set radio to standby: %d", state);
+        DLOGE(LOG_TAG, "failed to set radio to standby: %d", state);
     }
     radio_tx = false;
     radio_unlock();
 }
 
+// radio_tx_in_band tells whether a frame stays within the transmission edges of the current band. The frame occupies
+// roughly the deviation plus half the bit rate to each side of the carrier for FSK, or the bit rate for OOK.
+static bool radio_tx_in_band(const struct radio_tx_frame *frame)
+{
+    const struct radio_band_profile *profile = &RADIO_BANDS[radio_band];
+    float freq = frame->freq > 0 ? frame->freq : radio_tx_default_freq();
+    float half_width = (frame->ook ? frame->bit_rate_kbps : frame->freq_dev_khz + frame->bit_rate_kbps / 2) / 1000;
+    return freq - half_width >= profile->tx_min_freq && freq + half_width <= profile->tx_max_freq;
+}
+
+bool radio_tx_enqueue(const struct radio_tx_job *job)
+{
+    const struct radio_tx_frame *frame = job->frame;
+    if (frame == NULL || frame->data == NULL || frame->len <= 0 || frame->len > RADIO_TX_MAX_FRAME_LEN)
+    {
+        ESP_LOGE(LOG_TAG, "frame length must be between 1 and %d", RADIO_TX_MAX_FRAME_LEN);
+        return false;
+    }
+    float max_bit_rate = frame->ook ? RADIO_TX_MAX_OOK_BIT_RATE_KBPS : RADIO_TX_MAX_BIT_RATE_KBPS;
+    if (!(frame->bit_rate_kbps >= RADIO_TX_MIN_BIT_RATE_KBPS && frame->bit_rate_kbps <= max_bit_rate))
+    {
+        ESP_LOGE(LOG_TAG, "bit rate must be between %.1f and %.3f kbps", RADIO_TX_MIN_BIT_RATE_KBPS, max_bit_rate);
+        return false;
+    }
+    if (!frame->ook && !(frame->freq_dev_khz > 0))
+    {
+        ESP_LOGE(LOG_TAG, "FSK frequency deviation must be positive");
+        return false;
+    }
+    if (!radio_tx_in_band(frame))
+    {
+        ESP_LOGE(LOG_TAG, "frame at %.4f MHz exceeds the edges of the %s MHz band", frame->freq, RADIO_BANDS[radio_band].name);
+        return false;
+    }
+    if (job->repeats < 1 || job->bursts < 1)
+    {
+        ESP_LOGE(LOG_TAG, "a job needs at least one burst of one frame");
+        return false;
+    }
+    if (job->gap_micros < 0 || job->gap_micros > RADIO_TX_MAX_GAP_MILLIS * 1000 ||
+        job->burst_gap_millis < 0 || job->burst_gap_millis > RADIO_TX_MAX_GAP_MILLIS)
+    {
+        ESP_LOGE(LOG_TAG, "gaps must be between 0 and %d ms", RADIO_TX_MAX_GAP_MILLIS);
+        return false;
+    }
+    if (xQueueSend(tx_queue, job, 0) != pdTRUE)
+    {
+        DLOGW(LOG_TAG, "transmission queue is full");
+        return false;
+    }
+    return true;
+}
+
+// radio_tx_acquire takes the radio over from the scan for a burst of frames and configures the packet mode.
+// It returns false if push-to-talk is holding the radio or the band has changed under the frame.
+static bool radio_tx_acquire(const struct radio_tx_frame *frame)
+{
+    radio_tx_request = true;
+    radio_lock();
+    radio_tx_request = false;
+    if (radio_tx || tx_ptt_pending)
+    {
+        radio_unlock();
+        DLOGW(LOG_TAG, "push-to-talk is holding the radio, skipping a burst");
+        return false;
+    }
+    if (!radio_tx_in_band(frame))
+    {
+        radio_unlock();
+        DLOGE(LOG_TAG, "frame at %.4f MHz exceeds the edges of the %s MHz band, skipping a burst", frame->freq, RADIO_BANDS[radio_band].name);
+        return false;
+    }
+    radio_watch_unpark();
+    radio_tx_packet = true;
+    // Other lock holders leave the radio alone while radio_tx_packet is set, the frames are sent without the lock.
+    radio_unlock();
+
+    Module *mod = radio.getMod();
+    int state = radio.standby();
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set radio to standby: %d", state);
+    }
+    state = radio.setFrequency(frame->freq > 0 ? frame->freq : radio_tx_default_freq());
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set frequency: %d", state);
+    }
+    state = radio.setOOK(frame->ook);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set modulation: %d", state);
+    }
+    state = radio.setBitRate(frame->bit_rate_kbps);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set bit rate: %d", state);
+    }
+    if (!frame->ook)
+    {
+        state = radio.setFrequencyDeviation(frame->freq_dev_khz);
+        if (state != RADIOLIB_ERR_NONE)
+        {
+            DLOGE(LOG_TAG, "failed to set frequency deviation: %d", state);
+        }
+    }
+    // The frame is already encoded, so the packet engine adds no preamble, sync word, CRC or DC-free coding.
+    mod->SPIwriteRegister(REG_PREAMBLE_MSB, 0);
+    mod->SPIwriteRegister(REG_PREAMBLE_LSB, 0);
+    mod->SPIwriteRegister(REG_SYNC_CONFIG, mod->SPIreadRegister(REG_SYNC_CONFIG) & ~SYNC_CONFIG_SYNC_ON);
+    mod->SPIwriteRegister(REG_PACKET_CONFIG_1, 0);
+    mod->SPIwriteRegister(REG_PACKET_CONFIG_2, PACKET_CONFIG_2_DATA_MODE_PACKET | ((frame->len >> 8) & PACKET_CONFIG_2_PAYLOAD_LENGTH_MSB_MASK));
+    mod->SPIwriteRegister(REG_PAYLOAD_LENGTH, frame->len & 0xFF);
+    mod->SPIwriteRegister(REG_FIFO_THRESH, FIFO_THRESH_TX_START_FIFO_NOT_EMPTY | FIFO_REFILL_THRESHOLD);
+    // DIO0 signals PacketSent and DIO1 signals FifoLevel.
+    mod->SPIwriteRegister(REG_DIO_MAPPING_1, mod->SPIreadRegister(REG_DIO_MAPPING_1) & ~DIO_MAPPING_1_DIO0_DIO1_MASK);
+    return true;
+}
+
+// radio_tx_release restores the band configuration and hands the radio back to the scan.
+static void radio_tx_release()
+{
+    tx_active = false;
+    radio_lock();
+    radio_restore_band(radio_band, false);
+    // The register image already holds the band modulation, the setters bring RadioLib's copy of it up to date.
+    radio_apply_modulation(&RADIO_BANDS[radio_band]);
+    radio_tx_packet = false;
+    radio_unlock();
+}
+
+// radio_tx_prefill loads the beginning of a frame into the FIFO while the radio is in standby.
+static int radio_tx_prefill(const struct radio_tx_frame *frame)
+{
+    Module *mod = radio.getMod();
+    // Setting FifoOverrun clears whatever an aborted frame has left in the FIFO.
+    mod->SPIwriteRegister(REG_IRQ_FLAGS_1, IRQ_FLAGS_1_FIFO_OVERRUN);
+    int len = min(frame->len, FIFO_SIZE);
+    mod->SPIwriteRegisterBurst(REG_FIFO, (uint8_t *)frame->data, len);
+    return len;
+}
+
+// radio_tx_wait_until sleeps for the bulk of a wait and spins on the timer for the rest to keep gaps precise.
+// It returns false if push-to-talk cut the wait short.
+static bool radio_tx_wait_until(int64_t due_micros)
+{
+    int64_t remaining = due_micros - esp_timer_get_time();
+    while (remaining > TX_GAP_SPIN_MICROS)
+    {
+        // radio_tx_start notifies the task to cut the wait short.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((remaining - TX_GAP_SPIN_MICROS) / 1000));
+        if (tx_ptt_pending)
+        {
+            return false;
+        }
+        remaining = due_micros - esp_timer_get_time();
+    }
+    while (esp_timer_get_time() < due_micros)
+    {
+    }
+    return true;
+}
+
+// radio_tx_send waits until due_micros and sends a prefilled frame, refilling the FIFO each time DIO1 reports that its
+// level has dropped. It stores the local time at which the transmitter was keyed in start_micros, and returns the time
+// at which the frame finished, or 0 if it timed out or push-to-talk cut it short.
+static int64_t radio_tx_send(const struct radio_tx_frame *frame, int sent, int64_t due_micros, int64_t *start_micros)
+{
+    Module *mod = radio.getMod();
+    int64_t timeout_micros = (int64_t)frame->len * 8 * 1000 / frame->bit_rate_kbps + RADIO_TX_FRAME_TIMEOUT_MARGIN_MILLIS * 1000LL;
+    uint8_t op_mode_tx = (mod->SPIreadRegister(REG_OP_MODE) & ~OP_MODE_MASK) | OP_MODE_TX;
+    *start_micros = 0;
+    if (!radio_tx_wait_until(due_micros))
+    {
+        return 0;
+    }
+    // The wait and the frame are each shorter than the watchdog timeout, but not necessarily together.
+    esp_task_wdt_reset();
+    ulTaskNotifyTake(pdTRUE, 0);
+    tx_sent_micros = 0;
+    tx_active = true;
+    int64_t start = esp_timer_get_time();
+    mod->SPIwriteRegister(REG_OP_MODE, op_mode_tx);
+    *start_micros = start;
+    while (true)
+    {
+        uint8_t flags = mod->SPIreadRegister(REG_IRQ_FLAGS_2);
+        if (flags & IRQ_FLAGS_2_PACKET_SENT)
+        {
+            break;
+        }
+        if (tx_ptt_pending)
+        {
+            tx_active = false;
+            radio.standby();
+            DLOGW(LOG_TAG, "frame of %d bytes cut short by push-to-talk", frame->len);
+            return 0;
+        }
+        if (sent < frame->len && !(flags & IRQ_FLAGS_2_FIFO_LEVEL))
+        {
+            if (flags & IRQ_FLAGS_2_FIFO_EMPTY)
+            {
+                ++radio_tx_report.underruns;
+            }
+            // The FIFO holds at most FIFO_REFILL_THRESHOLD bytes now.
+            int len = min(frame->len - sent, FIFO_SIZE - FIFO_REFILL_THRESHOLD - 1);
+            mod->SPIwriteRegisterBurst(REG_FIFO, (uint8_t *)frame->data + sent, len);
+            sent += len;
+            continue;
+        }
+        int64_t remaining = start + timeout_micros - esp_timer_get_time();
+        if (remaining <= 0)
+        {
+            tx_active = false;
+            ++radio_tx_report.timeouts;
+            radio.standby();
+            DLOGE(LOG_TAG, "frame of %d bytes timed out", frame->len);
+            return 0;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(remaining / 1000 + 1));
+    }
+    // The interrupt time is the end of the frame, the flag may be polled well after it.
+    portENTER_CRITICAL(&tx_spinlock);
+    int64_t end = tx_sent_micros;
+    portEXIT_CRITICAL(&tx_spinlock);
+    if (end == 0)
+    {
+        end = esp_timer_get_time();
+    }
+    // The transmitter would otherwise stay keyed after the last bit.
+    mod->SPIwriteRegister(REG_OP_MODE, (mod->SPIreadRegister(REG_OP_MODE) & ~OP_MODE_MASK) | OP_MODE_STANDBY);
+    tx_active = false;
+    ++radio_tx_report.frames;
+    radio_tx_report.airtime_micros += end - start;
+    return end;
+}
+
+static void radio_tx_run_job(const struct radio_tx_job *job)
+{
+    const struct radio_tx_frame *frame = job->frame;
+    int64_t job_airtime = radio_tx_report.airtime_micros;
+    unsigned long job_underruns = radio_tx_report.underruns;
+    for (int burst = 0; burst < job->bursts; burst++)
+    {
+        if (burst > 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(job->burst_gap_millis));
+        }
+        esp_task_wdt_reset();
+        if (!radio_tx_acquire(frame))
+        {
+            continue;
+        }
+        int64_t last_end = 0;
+        for (int repeat = 0; repeat < job->repeats && !tx_ptt_pending; repeat++)
+        {
+            esp_task_wdt_reset();
+            int sent = radio_tx_prefill(frame);
+            int64_t start;
+            int64_t end = radio_tx_send(frame, sent, last_end > 0 ? last_end + job->gap_micros : 0, &start);
+            // The gap is measured from the end of the previous frame to the moment the transmitter was keyed again.
+            if (last_end > 0 && start > 0)
+            {
+                int64_t gap_error = llabs(start - last_end - job->gap_micros);
+                radio_tx_report.max_gap_error_micros = max(radio_tx_report.max_gap_error_micros, gap_error);
+            }
+            last_end = end;
+            if (last_end == 0)
+            {
+                break;
+            }
+        }
+        radio_tx_release();
+    }
+    DLOGI(LOG_TAG, "sent %d x %d frames of %d bytes, airtime %lld us, underruns %lu, max. gap error %lld us",
+          job->bursts, job->repeats, frame->len, radio_tx_report.airtime_micros - job_airtime,
+          radio_tx_report.underruns - job_underruns, radio_tx_report.max_gap_error_micros);
+}
+
+// The beacon is a preamble and sync word followed by a counting pattern, sent as FSK on the push-to-talk frequency.
+static uint8_t beacon_data[RADIO_TX_BEACON_LEN];
+static const struct radio_tx_frame beacon_frame = {beacon_data, RADIO_TX_BEACON_LEN, 4.8, false, 5.0, 0};
+
+// radio_tx_beacon queues two bursts of three test patterns. The job summary logged by radio_tx_run_job is to be
+// compared with the expected airtime and gap, a receiver on the bench decodes the pattern.
+static void radio_tx_beacon()
+{
+    for (int i = 0; i < RADIO_TX_BEACON_LEN; i++)
+    {
+        beacon_data[i] = i < 8 ? 0xAA : i;
+    }
+    beacon_data[8] = 0x2D;
+    beacon_data[9] = 0xD4;
+    struct radio_tx_job job = {&beacon_frame, 3, 10000, 2, 500};
+    if (radio_tx_enqueue(&job))
+    {
+        DLOGI(LOG_TAG, "beacon queued, expecting %d x %d frames of %lld us airtime, %d us apart",
+              job.bursts, job.repeats, (int64_t)(beacon_frame.len * 8 * 1000 / beacon_frame.bit_rate_kbps), job.gap_micros);
+    }
+}
+
+void radio_tx_task_fun(void *_)
+{
+    tx_task = xTaskGetCurrentTaskHandle();
+    int64_t next_beacon = esp_timer_get_time() + RADIO_TX_BEACON_INTERVAL_MILLIS * 1000LL;
+    while (true)
+    {
+        esp_task_wdt_reset();
+        if (RADIO_TX_BEACON_INTERVAL_MILLIS > 0 && esp_timer_get_time() >= next_beacon)
+        {
+            radio_tx_beacon();
+            next_beacon = esp_timer_get_time() + RADIO_TX_BEACON_INTERVAL_MILLIS * 1000LL;
+        }
+        struct radio_tx_job job;
+        if (xQueueReceive(tx_queue, &job, pdMS_TO_TICKS(RADIO_TX_TASK_INTERVAL_MILLIS)) == pdTRUE)
+        {
+            radio_tx_run_job(&job);
+        }
+    }
+}
+
+// radio_sched_next_bin picks the bin to sample in the next step. Bins are picked by their age weighted by activity,
+// and a bin that has gone unsampled for RADIO_SCHED_MAX_AGE_STEPS is picked regardless of its weight.
+static int radio_sched_next_bin()
+{
+    int best = 0, oldest = -1;
+    float best_score = -1;
+    uint32_t oldest_age = 0;
+    for (int i = 0; i < RADIO_MAX_STEPS; i++)
+    {
+        if (!bins[i].visited)
+        {
+            return i;
+        }
+        uint32_t age = scan_steps - bins[i].last_step;
+        if (age >= (uint32_t)RADIO_SCHED_MAX_AGE_STEPS && age > oldest_age)
+        {
+            oldest = i;
+            oldest_age = age;
+        }
+        float score = age * bins[i].weight;
+        if (score > best_score)
+        {
+            best = i;
+            best_score = score;
+        }
+    }
+    return oldest >= 0 ? oldest : best;
+}
+
+// radio_sched_update records a new sample of a bin.
+static void radio_sched_update(int bin, int rssi, int64_t now_micros)
+{
+    if (bins[bin].visited)
+    {
+        float delta = rssi - bins[bin].mean;
+        bins[bin].mean += delta / RADIO_SCHED_SMOOTHING;
+        bins[bin].variance += (delta * delta - bins[bin].variance) / RADIO_SCHED_SMOOTHING;
+        float interval = now_micros - bins[bin].last_micros;
+        // The first measured interval seeds the average, which would otherwise take many visits to climb up from 0.
+        if (bins[bin].interval_micros == 0)
+        {
+            bins[bin].interval_micros = interval;
+        }
+        else
+        {
+            bins[bin].interval_micros += (interval - bins[bin].interval_micros) / RADIO_SCHED_SMOOTHING;
+        }
+    }
+    else
+    {
+        bins[bin].visited = true;
+        bins[bin].mean = rssi;
+        bins[bin].weight = 1;
+    }
+    bins[bin].last_step = scan_steps;
+    bins[bin].last_micros = now_micros;
+    bins[bin].sample_index = (bins[bin].sample_index + 1) % RADIO_RECENT_SAMPLES;
+    radio_rssi[bin][bins[bin].sample_index] = rssi;
+}
+
+// radio_sched_reweigh updates the weight of each bin from its level above the quietest bin and its variance.
+static void radio_sched_reweigh()
+{
+    float floor = 0;
+    for (int i = 0; i < RADIO_MAX_STEPS; i++)
+    {
+        if (i == 0 || bins[i].mean < floor)
+        {
+            floor = bins[i].mean;
+        }
+    }
+    sched_floor = floor;
+    for (int i = 0; i < RADIO_MAX_STEPS; i++)
+    {
+        float activity = (bins[i].mean - floor + sqrtf(bins[i].variance)) / RADIO_SCHED_ACTIVITY_DB;
+        bins[i].weight = constrain(1 + activity, 1, RADIO_SCHED_MAX_WEIGHT);
+    }
+}
+
+// radio_sched_report logs the range of the effective per-bin sample rates. The caller must hold the radio lock.
+static void radio_sched_report()
+{
+    float min_rate = 0, max_rate = 0;
+    int64_t max_age = 0, now = esp_timer_get_time();
+    for (int i = 0; i < RADIO_MAX_STEPS; i++)
+    {
+        float rate = bins[i].interval_micros > 0 ? 1000000 / bins[i].interval_micros : 0;
+        if (i == 0 || rate < min_rate)
+        {
+            min_rate = rate;
+        }
+        if (rate > max_rate)
+        {
+            max_rate = rate;
+        }
+        max_age = max(max_age, now - bins[i].last_micros);
+    }
+    DLOGI(LOG_TAG, "bins are sampled at %.1f to %.1f Hz, the oldest sample is %lld us old", min_rate, max_rate, max_age);
+}
+
+static float radio_bin_freq(int bin)
+{
+    return radio_centre_freq + (RADIO_BANDS[radio_band].step_size * (bin - (RADIO_MAX_STEPS / 2)));
+}
+
+// radio_sample_bin retunes to a bin, reads its RSSI and hands the sample to the scheduler. The caller must hold the radio lock.
+static int radio_sample_bin(int bin)
+{
+    float freq = radio_bin_freq(bin);
+    int state = radio.setFrequency(freq);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to set frequency %.4f MHz: %d", freq, state);
+    }
+    state = radio.startReceive();
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        DLOGE(LOG_TAG, "failed to start receive at %.4f MHz: %d", freq, state);
+    }
+    int rssi = (int)radio.getRSSI();
+    radio_sched_update(bin, rssi, esp_timer_get_time());
+    ++scan_steps;
+    return rssi;
+}
+
 void radio_scan()
 {
-    sample_index = (sample_index + 1) % RADIO_RECENT_SAMPLES;
     int start = millis();
     radio_lock();
-    if (radio_tx)
+    if (radio_busy())
+    {
+        radio_unlock();
+        return;
+    }
+    radio_watch_unpark();
+    // An interrupted sweep resumes with the steps it has left.
+    if (scan_next_step == 0)
+    {
+        scan_start_micros = esp_timer_get_time();
+        pass_peak_rssi = -200;
+    }
+    for (int i = scan_next_step; i < RADIO_MAX_STEPS; i++)
+    {
+        // Yield the radio to a pending transmission, the latency is bounded by the dwell of a single step.
+        if (radio_tx_request)
+        {
+            scan_next_step = i;
+            radio_scan_partial = true;
+            radio_unlock();
+            return;
+        }
+        int rssi = radio_sample_bin(radio_sched_next_bin());
+        pass_peak_rssi = max(pass_peak_rssi, rssi);
+    }
+    radio_sched_reweigh();
+    if (pass_peak_rssi - sched_floor < RADIO_WATCH_THRESHOLD_DB)
+    {
+        ++watch_idle_sweeps;
+    }
+    else
+    {
+        watch_idle_sweeps = 0;
+    }
+    scan_next_step = 0;
+    radio_scan_partial = false;
+    ++scan_complete_sweeps;
+    if (++radio_complete_sweeps % RADIO_SCHED_REPORT_SWEEPS == 0)
+    {
+        radio_sched_report();
+    }
+    gps_stamp(scan_start_micros, &radio_sweep_stamp);
+    radio_unlock();
+    if (radio_first_sweep_micros == 0)
+    {
+        radio_first_sweep_micros = esp_timer_get_time();
+        DLOGI(LOG_TAG, "first sweep completed %lld us after boot", radio_first_sweep_micros);
+    }
+    // ESP_LOGI(LOG_TAG, "radio scan completed in %d ms", millis() - start);
+}
+
+// radio_watch parks on the most active bins in turn and sleeps until the RSSI threshold interrupt fires, then sweeps
+// straight away to capture the burst.
+void radio_watch()
+{
+    int channels[RADIO_WATCH_MAX_CHANNELS];
+    int num_channels = 0;
+    radio_lock();
+    if (radio_busy())
     {
         radio_unlock();
         return;
     }
+    // Pick the bins with the highest weight, insertion sort suffices for a handful of channels.
     for (int i = 0; i < RADIO_MAX_STEPS; i++)
     {
-        float freq = radio_centre_freq + (RADIO_STEP_SIZE * (i - (RADIO_MAX_STEPS / 2)));
-        int state = radio.setFrequency(freq);
-        if (state != RADIOLIB_ERR_NONE)
+        int pos = num_channels < RADIO_WATCH_MAX_CHANNELS ? num_channels++ : RADIO_WATCH_MAX_CHANNELS;
+        while (pos > 0 && bins[channels[pos - 1]].weight < bins[i].weight)
         {
-            ESP_LOGE(LOG_TAG, "failed to set frequency %.4f MHz: %d", freq, state);
+            if (pos < RADIO_WATCH_MAX_CHANNELS)
+            {
+                channels[pos] = channels[pos - 1];
+            }
+            --pos;
         }
-        state = radio.startReceive();
-        if (state != RADIOLIB_ERR_NONE)
+        if (pos < RADIO_WATCH_MAX_CHANNELS)
         {
-            ESP_LOGE(LOG_TAG, "failed to start receive at %.4f MHz: %d", freq, state);
+            channels[pos] = i;
         }
-        int rssi = (int)radio.getRSSI();
-        radio_rssi[i][sample_index] = rssi;
     }
+    float threshold_dbm = sched_floor + RADIO_WATCH_THRESHOLD_DB;
+    radio_watching = true;
     radio_unlock();
-    // ESP_LOGI(LOG_TAG, "radio scan completed in %d ms", millis() - start);
+    DLOGI(LOG_TAG, "band is idle, watching for bursts above %.1f dBm", threshold_dbm);
+
+    bool triggered = false;
+    int64_t watch_start = esp_timer_get_time();
+    for (int round = 0; !triggered && esp_timer_get_time() - watch_start < RADIO_WATCH_MAX_MILLIS * 1000LL; round++)
+    {
+        esp_task_wdt_reset();
+        int bin = channels[round % num_channels];
+        radio_lock();
+        if (radio_busy())
+        {
+            radio_unlock();
+            break;
+        }
+        radio_watch_park(radio_bin_freq(bin), threshold_dbm);
+        ulTaskNotifyTake(pdTRUE, 0);
+        watch_bin = bin;
+        watch_armed = true;
+        radio_watch_listen();
+        radio_unlock();
+        // The radio stays unlocked while waiting, so that a transmission does not wait for the dwell.
+        triggered = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RADIO_WATCH_DWELL_MILLIS)) > 0;
+        watch_armed = false;
+    }
+    radio_watching = false;
+    watch_idle_sweeps = 0;
+    if (!triggered)
+    {
+        return;
+    }
+    int64_t trigger = watch_trigger_micros;
+    radio_lock();
+    if (radio_busy())
+    {
+        radio_unlock();
+        return;
+    }
+    // Capture the bin that triggered before anything else, then sweep the rest of the band for the detail.
+    radio_watch_unpark();
+    int bin = watch_trigger_bin;
+    int rssi = radio_sample_bin(bin);
+    radio_watch_latency_micros = esp_timer_get_time() - trigger;
+    radio_watch_latency_max_micros = max(radio_watch_latency_max_micros, radio_watch_latency_micros);
+    radio_detection.bin = bin;
+    radio_detection.freq = radio_bin_freq(bin);
+    radio_detection.rssi = rssi;
+    gps_stamp(trigger, &radio_detection.stamp);
+    radio_unlock();
+    radio_scan();
+    DLOGI(LOG_TAG, "burst of %d dBm at %.4f MHz captured %lld us after trigger (max. %lld us), sweep completed %lld us after trigger",
+          rssi, radio_detection.freq, radio_watch_latency_micros, radio_watch_latency_max_micros, esp_timer_get_time() - trigger);
 }
 
 void radio_task_fun(void *_)
 {
+    radio_task = xTaskGetCurrentTaskHandle();
     while (true)
     {
         esp_task_wdt_reset();
+        if (RADIO_WATCH_IDLE_SWEEPS > 0 && watch_idle_sweeps >= RADIO_WATCH_IDLE_SWEEPS)
+        {
+            radio_watch();
+        }
         radio_scan();
+        if (RADIO_BAND_HOP_SWEEPS > 0 && scan_complete_sweeps >= RADIO_BAND_HOP_SWEEPS)
+        {
+            scan_complete_sweeps = 0;
+            radio_set_band((radio_band + 1) % RADIO_NUM_BANDS);
+        }
         vTaskDelay(pdMS_TO_TICKS(RADIO_TASK_INTERVAL_MILLIS));
     }
 }
\ No newline at end of file
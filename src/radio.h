@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+#include "gps.h"
+
 const int RADIO_TASK_INTERVAL_MILLIS = 2;
 const int RADIO_MUTEX_TIMEOUT_MILLIS = 1000;
 
@@ -8,18 +11,179 @@ const int RADIO_DIO0_PIN = 26;
 const int RADIO_RESET_PIN = 23;
 const int RADIO_DIO1_PIN = 33;
 
-const float RADIO_FIRST_CHAN = 868.0;
-const float RADIO_STEP_SIZE = 0.20;
 const int RADIO_MAX_STEPS = 25;
 const int RADIO_RECENT_SAMPLES = 4;
+// RADIO_BAND_HOP_SWEEPS is the number of complete sweeps before the scan hops to the next band, 0 stays on one band.
+const int RADIO_BAND_HOP_SWEEPS = 0;
+
+// The sweep scheduler revisits active bins more often, yet every bin is refreshed at least once in this many steps.
+const int RADIO_SCHED_MAX_AGE_STEPS = RADIO_MAX_STEPS * 4;
+// RADIO_SCHED_MAX_WEIGHT caps how many times more often an active bin is revisited than a quiet one.
+const float RADIO_SCHED_MAX_WEIGHT = 8.0;
+// Every RADIO_SCHED_ACTIVITY_DB of mean level above the quietest bin, or of RSSI deviation, adds one to the weight of a bin.
+const float RADIO_SCHED_ACTIVITY_DB = 3.0;
+// RADIO_SCHED_SMOOTHING is the reciprocal of the weight given to each new sample in the per-bin averages.
+const int RADIO_SCHED_SMOOTHING = 8;
+const int RADIO_SCHED_REPORT_SWEEPS = 1000;
+
+// After this many consecutive sweeps without energy above the noise floor, the radio parks on the most active bins
+// and waits for the RSSI threshold interrupt instead of polling. 0 disables the watch mode.
+const int RADIO_WATCH_IDLE_SWEEPS = 50;
+const int RADIO_WATCH_MAX_CHANNELS = 3;
+// RADIO_WATCH_THRESHOLD_DB is the level above the noise floor that counts as a burst.
+const float RADIO_WATCH_THRESHOLD_DB = 10.0;
+const int RADIO_WATCH_DWELL_MILLIS = 200;
+// A watch ends after this long even without a burst, so that the quiet bins are still refreshed by a sweep.
+const int RADIO_WATCH_MAX_MILLIS = 2000;
+
+const int RADIO_TX_QUEUE_LEN = 8;
+// RADIO_TX_MAX_FRAME_LEN is the longest payload the SX1276 fixed length packet mode can send, refilling its 64 byte FIFO.
+const int RADIO_TX_MAX_FRAME_LEN = 2047;
+const int RADIO_TX_TASK_INTERVAL_MILLIS = 10;
+// A frame is abandoned when it takes this much longer than its nominal airtime.
+const int RADIO_TX_FRAME_TIMEOUT_MARGIN_MILLIS = 100;
+// The gaps between frames and between bursts are capped well below the task watchdog timeout.
+const int RADIO_TX_MAX_GAP_MILLIS = 30000;
+// The SX1276 bit rate range, OOK tops out lower than FSK.
+const float RADIO_TX_MIN_BIT_RATE_KBPS = 0.5;
+const float RADIO_TX_MAX_BIT_RATE_KBPS = 300.0;
+const float RADIO_TX_MAX_OOK_BIT_RATE_KBPS = 32.768;
+// push-to-talk waits this long for the packet transmission engine to give up the radio.
+const int RADIO_TX_PTT_YIELD_MILLIS = 1000;
+// RADIO_TX_BEACON_INTERVAL_MILLIS is how often a test pattern is sent to check the airtime, gap and underrun reporting
+// on the bench, 0 disables the beacon. The pattern is longer than the FIFO, so that it has to be refilled. Each beacon
+// takes two seconds of airtime, mind the 1% duty cycle limit of the 868.0-868.6 MHz band.
+const int RADIO_TX_BEACON_INTERVAL_MILLIS = 0;
+const int RADIO_TX_BEACON_LEN = 200;
+
+// radio_band_profile describes the channel plan and receiver settings of an ISM band.
+struct radio_band_profile
+{
+    const char *name;
+    // first_chan is the frequency of the lowest scan step in MHz.
+    float first_chan, step_size;
+    float rx_bandwidth_khz, afc_bandwidth_khz;
+    bool afc;
+    // max_power_dbm is the transmission power limit permitted between tx_min_freq and tx_max_freq, the edges in MHz of
+    // the band that transmissions have to stay within. The scan may cover more than that.
+    int max_power_dbm;
+    float tx_min_freq, tx_max_freq;
+    // The modulation of the receiver, the packet transmission engine sets it back after each burst.
+    bool ook;
+    float bit_rate_kbps, freq_dev_khz;
+};
+
+const struct radio_band_profile RADIO_BANDS[] = {
+    // ETSI EN 300 220 - 10mW ERP in the 433.05-434.79 MHz band.
+    {"433", 433.05, 0.07, 2.6, 2.6, true, 10, 433.05, 434.79, true, 0.5, 0.6},
+    // ETSI EN 300 220 - 25mW ERP in the 868.0-868.6 MHz band.
+    {"868", 868.0, 0.20, 2.6, 2.6, true, 14, 868.0, 868.6, true, 0.5, 0.6},
+    // FCC part 15.247 - the SX1276 PA tops out well below the 1W limit in the 902-928 MHz band.
+    {"915", 902.0, 0.20, 2.6, 2.6, true, 20, 902.0, 928.0, true, 0.5, 0.6},
+};
+const int RADIO_NUM_BANDS = sizeof(RADIO_BANDS) / sizeof(RADIO_BANDS[0]);
+const int RADIO_DEFAULT_BAND = 1;
+
+// radio_saved_state is the sweep configuration and trace history carried across a warm restart.
+struct radio_saved_state
+{
+    int band;
+    int sample_index[RADIO_MAX_STEPS];
+    int rssi[RADIO_MAX_STEPS][RADIO_RECENT_SAMPLES];
+    uint32_t complete_sweeps;
+    int64_t tx_latency_max_micros;
+};
+
+// radio_bin_stats describes how the sweep scheduler sees a bin.
+struct radio_bin_stats
+{
+    float mean_rssi, stddev_rssi;
+    // weight is the relative revisit rate of the bin, 1 being the rate of a quiet bin.
+    float weight;
+    float sample_rate_hz;
+    // age_micros is the time since the latest sample of the bin.
+    int64_t age_micros;
+};
+
+// radio_tx_frame is a frame encoded ahead of time. Its data is sent verbatim without preamble, sync word or CRC,
+// hence those have to be encoded into the data along with the line coding of the remote being replayed.
+struct radio_tx_frame
+{
+    const uint8_t *data;
+    int len;
+    float bit_rate_kbps;
+    bool ook;
+    // freq_dev_khz is the FSK frequency deviation, it is unused by OOK.
+    float freq_dev_khz;
+    // freq is the carrier frequency in MHz, 0 stands for the carrier frequency of push-to-talk. The frame has to stay
+    // within the transmission edges of the current band, bit rate and deviation included.
+    float freq;
+};
+
+// radio_tx_job sends bursts of repeated frames. The frame must stay valid until the job is done.
+struct radio_tx_job
+{
+    const struct radio_tx_frame *frame;
+    // repeats is the number of frames in a burst, gap_micros is the idle time between the end of a frame and the start
+    // of the next.
+    int repeats, gap_micros;
+    // The radio returns to scanning during the gap between bursts. push-to-talk cuts a burst short.
+    int bursts, burst_gap_millis;
+};
+
+// radio_tx_report accumulates the outcome of packet transmissions.
+struct radio_tx_report
+{
+    unsigned long frames, underruns, timeouts;
+    int64_t airtime_micros;
+    // max_gap_error_micros is the largest deviation of an inter-frame gap from the requested gap.
+    int64_t max_gap_error_micros;
+};
+
+// radio_detection describes a burst that woke the watch mode.
+struct radio_detection
+{
+    int bin;
+    float freq;
+    int rssi;
+    // stamp is the GPS time and position of the interrupt.
+    struct gps_timestamp stamp;
+};
 
 extern bool radio_tx;
+// radio_tx_packet is true while the packet transmission engine owns the radio.
+extern bool radio_tx_packet;
+extern struct radio_tx_report radio_tx_report;
+// radio_tx_request is raised by radio_tx_start to make an ongoing scan yield the radio at the next step.
+extern volatile bool radio_tx_request;
+// radio_scan_partial is true while the latest sweep was interrupted and has yet to resume.
+extern bool radio_scan_partial;
+extern int radio_band;
 extern float radio_centre_freq;
 extern int radio_rssi[RADIO_MAX_STEPS][RADIO_RECENT_SAMPLES];
+// Press-to-carrier latency of the latest and the slowest transmission, in microseconds.
+extern int64_t radio_tx_latency_micros, radio_tx_latency_max_micros;
+// radio_watching is true while the radio is parked waiting for the RSSI threshold interrupt.
+extern bool radio_watching;
+// Latency between the RSSI threshold interrupt and the RSSI read of the triggering bin, the latest and the slowest.
+extern int64_t radio_watch_latency_micros, radio_watch_latency_max_micros;
+// radio_detection is the latest burst caught by the watch mode.
+extern struct radio_detection radio_detection;
+// radio_first_sweep_micros is the time between boot and the completion of the first sweep.
+extern int64_t radio_first_sweep_micros;
+extern uint32_t radio_complete_sweeps;
+// radio_sweep_stamp is the GPS time and position at the start of the latest complete sweep.
+extern struct gps_timestamp radio_sweep_stamp;
 
 void radio_init();
 void radio_lock();
 void radio_unlock();
 void radio_tx_start();
 void radio_tx_stop();
+bool radio_tx_enqueue(const struct radio_tx_job *job);
+void radio_tx_task_fun(void *);
+void radio_set_band(int band);
+bool radio_get_bin_stats(int bin, struct radio_bin_stats *stats);
+bool radio_save_state(struct radio_saved_state *state);
+void radio_restore_state(const struct radio_saved_state *state);
 void radio_task_fun(void *);
\ No newline at end of file
@@ -6,9 +6,12 @@
 #include "supervisor.h"
 #include "button.h"
 #include "radio.h"
+#include "gps.h"
+#include "dlog.h"
+#include "warmboot.h"
 
 static const char LOG_TAG[] = __FILE__;
-static TaskHandle_t oled_task, button_task, radio_task, supervisor_task;
+static TaskHandle_t dlog_task, oled_task, gps_task, button_task, radio_task, radio_tx_task, supervisor_task;
 
 void supervisor_init()
 {
@@ -48,10 +51,17 @@ void supervisor_init()
 
     // A numerically higher number enjoys higher runtime priority.
     unsigned long priority = tskIDLE_PRIORITY;
+    xTaskCreate(dlog_task_fun, "dlog_task_loop", 16 * 1024, NULL, priority++, &dlog_task);
+    ESP_ERROR_CHECK(esp_task_wdt_add(dlog_task));
     xTaskCreate(oled_task_fun, "oled_task_loop", 16 * 1024, NULL, priority++, &oled_task);
     ESP_ERROR_CHECK(esp_task_wdt_add(oled_task));
+    xTaskCreate(gps_task_fun, "gps_task_loop", 16 * 1024, NULL, priority++, &gps_task);
+    ESP_ERROR_CHECK(esp_task_wdt_add(gps_task));
     xTaskCreate(radio_task_fun, "radio_task_loop", 16 * 1024, NULL, priority++, &radio_task);
     ESP_ERROR_CHECK(esp_task_wdt_add(radio_task));
+    // Packet transmission outranks the scan to keep inter-frame gaps precise.
+    xTaskCreate(radio_tx_task_fun, "radio_tx_task_loop", 16 * 1024, NULL, priority++, &radio_tx_task);
+    ESP_ERROR_CHECK(esp_task_wdt_add(radio_tx_task));
     xTaskCreate(button_task_fun, "button_task_loop", 16 * 1024, NULL, priority++, &button_task);
     ESP_ERROR_CHECK(esp_task_wdt_add(button_task));
     xTaskCreate(supervisor_task_fun, "supervisor_task_loop", 16 * 1024, NULL, priority++, &supervisor_task);
@@ -64,6 +74,8 @@ void supervisor_task_fun(void *_)
     while (true)
     {
         supervisor_health_check();
+        // Keep the RTC memory copy fresh so that a watchdog reset loses little of the state.
+        warmboot_save();
         esp_task_wdt_reset();
         vTaskDelay(pdMS_TO_TICKS(SUPERVISOR_TASK_LOOP_INTERVAL_MILLIS));
     }
@@ -77,18 +89,29 @@ void supervisor_health_check()
              ESP.getMaxAllocHeap() / 1024, uxTaskGetStackHighWaterMark(NULL) / 1024);
     UBaseType_t button_stack_free = uxTaskGetStackHighWaterMark(button_task),
                 radio_stack_free = uxTaskGetStackHighWaterMark(radio_task),
+                radio_tx_stack_free = uxTaskGetStackHighWaterMark(radio_tx_task),
+                dlog_stack_free = uxTaskGetStackHighWaterMark(dlog_task),
                 oled_stack_free = uxTaskGetStackHighWaterMark(oled_task),
+                gps_stack_free = uxTaskGetStackHighWaterMark(gps_task),
                 supervisor_stack_free = uxTaskGetStackHighWaterMark(supervisor_task);
     if (heap_min_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD ||
         button_stack_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD ||
         radio_stack_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD ||
+        radio_tx_stack_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD ||
+        dlog_stack_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD ||
         oled_stack_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD ||
+        gps_stack_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD ||
         supervisor_stack_free < SUPERVISOR_FREE_MEM_REBOOT_THRESHOLD)
     {
         ESP_LOGE(LOG_TAG, "button task state: %d, min.free stack: %dKB", eTaskGetState(button_task), button_stack_free);
         ESP_LOGE(LOG_TAG, "radio task state: %d, min.free stack: %dKB", eTaskGetState(radio_task), radio_stack_free);
+        ESP_LOGE(LOG_TAG, "radio tx task state: %d, min.free stack: %dKB", eTaskGetState(radio_tx_task), radio_tx_stack_free);
+        ESP_LOGE(LOG_TAG, "dlog task state: %d, min.free stack: %dKB", eTaskGetState(dlog_task), dlog_stack_free);
         ESP_LOGE(LOG_TAG, "oled task state: %d, min.free stack: %dKB", eTaskGetState(oled_task), oled_stack_free);
+        ESP_LOGE(LOG_TAG, "gps task state: %d, min.free stack: %dKB", eTaskGetState(gps_task), gps_stack_free);
         ESP_LOGE(LOG_TAG, "supervisor task state: %d, min.free stack: %dKB", eTaskGetState(supervisor_task), supervisor_stack_free);
+        warmboot_save();
+        dlog_flush();
         esp_restart();
     }
 }
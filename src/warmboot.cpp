@@ -0,0 +1,74 @@
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "warmboot.h"
+#include "radio.h"
+
+static const char LOG_TAG[] = __FILE__;
+
+bool warmboot_is_warm = false;
+RTC_NOINIT_ATTR struct warmboot_state warmboot;
+// save_mutex keeps the loop task and the supervisor from interleaving their saves, which would leave a stale crc.
+static SemaphoreHandle_t save_mutex = xSemaphoreCreateMutex();
+
+uint32_t warmboot_checksum(const void *data, size_t len)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)data, len);
+}
+
+static uint32_t warmboot_state_crc()
+{
+    return warmboot_checksum(&warmboot, offsetof(struct warmboot_state, crc));
+}
+
+void warmboot_init()
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool soft_reset = reason == ESP_RST_SW || reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT ||
+                      reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT || reason == ESP_RST_DEEPSLEEP;
+    warmboot_is_warm = soft_reset && warmboot.magic == WARMBOOT_MAGIC && warmboot.crc == warmboot_state_crc();
+    if (warmboot_is_warm)
+    {
+        ++warmboot.warm_boot_count;
+    }
+    else
+    {
+        // The RTC memory content is garbage after a power cycle.
+        memset(&warmboot, 0, sizeof(warmboot));
+        warmboot.magic = WARMBOOT_MAGIC;
+    }
+    ++warmboot.boot_count;
+    warmboot.crc = warmboot_state_crc();
+    ESP_LOGI(LOG_TAG, "%s boot (reset reason %d), boot count %u, warm boot count %u", warmboot_is_warm ? "warm" : "cold",
+             reason, warmboot.boot_count, warmboot.warm_boot_count);
+}
+
+void warmboot_restore()
+{
+    if (warmboot_is_warm)
+    {
+        radio_restore_state(&warmboot.radio);
+        ESP_LOGI(LOG_TAG, "restored radio state from RTC memory");
+    }
+}
+
+void warmboot_save()
+{
+    // A save that is already under way leaves a consistent block behind, there is no need to repeat it.
+    if (xSemaphoreTake(save_mutex, WARMBOOT_MUTEX_TIMEOUT_MILLIS) == pdFALSE)
+    {
+        ESP_LOGW(LOG_TAG, "another task is saving the warm boot state");
+        return;
+    }
+    // The previously saved radio state stays intact and valid when the radio lock cannot be obtained.
+    if (!radio_save_state(&warmboot.radio))
+    {
+        ESP_LOGW(LOG_TAG, "radio is busy, keeping the previously saved radio state");
+    }
+    warmboot.crc = warmboot_state_crc();
+    xSemaphoreGive(save_mutex);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "radio.h"
+
+const uint32_t WARMBOOT_MAGIC = 0x687a676c;
+// The save waits for the radio lock at most RADIO_MUTEX_TIMEOUT_MILLIS, a concurrent save is done well within this.
+const int WARMBOOT_MUTEX_TIMEOUT_MILLIS = RADIO_MUTEX_TIMEOUT_MILLIS * 2;
+
+// warmboot_state lives in RTC slow memory, which survives software and watchdog resets but not a power cycle.
+struct warmboot_state
+{
+    uint32_t magic;
+    uint32_t boot_count, warm_boot_count;
+    // pmu_config_checksum is the checksum of the PMU configuration registers after they were last programmed.
+    uint32_t pmu_config_checksum;
+    struct radio_saved_state radio;
+    // crc covers all of the fields above.
+    uint32_t crc;
+};
+
+extern bool warmboot_is_warm;
+extern struct warmboot_state warmboot;
+
+void warmboot_init();
+void warmboot_restore();
+void warmboot_save();
+uint32_t warmboot_checksum(const void *data, size_t len);
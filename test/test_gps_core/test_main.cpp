@@ -0,0 +1,171 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "gps_core.h"
+
+// 2024-03-09 12:00:00 UTC, the first epoch of the recording.
+static const int64_t REPLAY_EPOCH_MICROS = 1709985600LL * 1000000;
+
+static struct gps_nmea_parser parser;
+static struct gps_timebase timebase;
+static FILE *replay;
+static char pending[128];
+
+void setUp()
+{
+    memset(&parser, 0, sizeof(parser));
+    gps_timebase_init(&timebase);
+    pending[0] = '\0';
+    // The recording sits next to this file.
+    char path[256];
+    snprintf(path, sizeof(path), "%s", __FILE__);
+    char *slash = strrchr(path, '/');
+    strcpy(slash != NULL ? slash + 1 : path, "replay.txt");
+    replay = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(replay, path);
+}
+
+void tearDown()
+{
+    if (replay != NULL)
+    {
+        fclose(replay);
+    }
+}
+
+// replay_line plays a line of recorded GPS activity the way the GPS task and its PPS interrupt would.
+static void replay_line(const char *line)
+{
+    int64_t local_micros;
+    enum gps_nmea_event event = gps_nmea_replay_line(&parser, line, &local_micros);
+    if (event == GPS_NMEA_PPS)
+    {
+        gps_timebase_pps(&timebase, local_micros);
+    }
+    else if (event == GPS_NMEA_RMC)
+    {
+        gps_timebase_anchor(&timebase, parser.rmc_utc_micros, local_micros);
+    }
+}
+
+// replay_until plays the recording up to and including the given local time.
+static void replay_until(int64_t local_micros)
+{
+    while (true)
+    {
+        if (pending[0] == '\0' && fgets(pending, sizeof(pending), replay) == NULL)
+        {
+            return;
+        }
+        if (pending[0] == '#' || pending[0] == '\n')
+        {
+            pending[0] = '\0';
+            continue;
+        }
+        if (strtoll(pending, NULL, 10) > local_micros)
+        {
+            return;
+        }
+        replay_line(pending);
+        pending[0] = '\0';
+    }
+}
+
+static void test_replay_utc_and_rate()
+{
+    // Without a preceding PPS edge the first sentence anchors the timebase by its own arrival.
+    replay_until(1300000);
+    TEST_ASSERT_TRUE(timebase.anchored);
+    TEST_ASSERT_FALSE(timebase.anchored_pps);
+    TEST_ASSERT_EQUAL_INT64(REPLAY_EPOCH_MICROS, gps_timebase_utc(&timebase, 1300000));
+
+    replay_until(2300100);
+    TEST_ASSERT_TRUE(timebase.anchored_pps);
+    TEST_ASSERT_EQUAL_INT64(REPLAY_EPOCH_MICROS + 1000000, gps_timebase_utc(&timebase, 2000100));
+
+    replay_until(8380700);
+    TEST_ASSERT_TRUE(timebase.anchored_pps);
+    TEST_ASSERT_EQUAL_INT64(REPLAY_EPOCH_MICROS + 7000000, gps_timebase_utc(&timebase, 8000700));
+    TEST_ASSERT_INT64_WITHIN(50, REPLAY_EPOCH_MICROS + 7300000, gps_timebase_utc(&timebase, 8300700));
+    // The estimate converges on the 100 ppm of the recorded oscillator.
+    double rate_ppm = (timebase.rate - 1.0) * 1e6;
+    TEST_ASSERT_TRUE(rate_ppm > 30 && rate_ppm < 100);
+}
+
+static void test_replay_position()
+{
+    replay_until(1380000);
+    TEST_ASSERT_TRUE(parser.has_fix);
+    TEST_ASSERT_EQUAL_INT(8, parser.satellites);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 51.5, parser.latitude);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, -7.0 / 60, parser.longitude);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 45.0, parser.altitude_metre);
+    TEST_ASSERT_EQUAL_UINT32(0, parser.sentence_errors);
+}
+
+static void test_replay_rejects_noise_edge()
+{
+    replay_until(4500300);
+    TEST_ASSERT_EQUAL_UINT32(1, timebase.pps_rejected);
+    TEST_ASSERT_TRUE(timebase.anchored_pps);
+    // The noise at 4400300 must not become the anchor of 12:00:03.
+    TEST_ASSERT_EQUAL_INT64(4000300, timebase.anchor_local_micros);
+    TEST_ASSERT_EQUAL_INT64(REPLAY_EPOCH_MICROS + 3000000, gps_timebase_utc(&timebase, 4000300));
+}
+
+static void test_replay_ignores_late_sentence()
+{
+    replay_until(6100500);
+    // The sentence of 12:00:04 arrived after the edge of 12:00:05, the timebase stays where it was.
+    TEST_ASSERT_EQUAL_INT64(4000300, timebase.anchor_local_micros);
+    TEST_ASSERT_TRUE(timebase.anchored_pps);
+    TEST_ASSERT_INT64_WITHIN(1000, REPLAY_EPOCH_MICROS + 5000000, gps_timebase_utc(&timebase, 6000500));
+}
+
+static void test_noise_edge_before_sentence()
+{
+    const char *lines[] = {
+        "1000000 PPS",
+        "2000100 PPS",
+        "2400000 PPS",
+        "2500000 $GPRMC,120001.00,A,5130.00000,N,00007.00000,W,0.010,,090324,,,A*6D",
+    };
+    for (const char *line : lines)
+    {
+        replay_line(line);
+    }
+    TEST_ASSERT_TRUE(timebase.anchored_pps);
+    TEST_ASSERT_EQUAL_INT64(REPLAY_EPOCH_MICROS + 1000000, gps_timebase_utc(&timebase, 2000100));
+}
+
+static void test_floating_pps_input()
+{
+    const char *lines[] = {
+        "1000000 PPS",
+        "1300000 PPS",
+        "1350000 PPS",
+        "2900000 PPS",
+        "3000000 $GPRMC,120001.00,A,5130.00000,N,00007.00000,W,0.010,,090324,,,A*6D",
+    };
+    for (const char *line : lines)
+    {
+        replay_line(line);
+    }
+    // None of the edges came a second after another, so the timebase follows the sentence alone.
+    TEST_ASSERT_TRUE(timebase.anchored);
+    TEST_ASSERT_FALSE(timebase.anchored_pps);
+    TEST_ASSERT_EQUAL_INT64(REPLAY_EPOCH_MICROS + 1000000, gps_timebase_utc(&timebase, 3000000));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_utc_and_rate);
+    RUN_TEST(test_replay_position);
+    RUN_TEST(test_replay_rejects_noise_edge);
+    RUN_TEST(test_replay_ignores_late_sentence);
+    RUN_TEST(test_noise_edge_before_sentence);
+    RUN_TEST(test_floating_pps_input);
+    return UNITY_END();
+}